@@ -0,0 +1,223 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "array_merge.h"
+#include "compare_kernels.h"
+#include "merge_decision.h"
+#include "simd.h"
+
+
+void DiffArrayElements(const char* first, const char* second, size_t elementSize, size_t elementCount, uint64_t* changedMask)
+{
+    memset(changedMask, 0, ((elementCount + 63) / 64) * sizeof(uint64_t));
+    if (elementSize == 0)
+    {
+        return;
+    }
+    size_t element = 0;
+#if BINMERGE_SSE2
+    // diff the whole array as plain bytes, 16 at a time, whatever the element size (12 byte Vector3s included),
+    // and map each changed byte back to its element. Big arrays are usually mostly untouched,
+    // so the inner loop rarely runs
+    const size_t total = elementSize * elementCount;
+    size_t offset = 0;
+    for (; offset + 16 <= total; offset += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(first + offset));
+        __m128i b = _mm_loadu_si128((const __m128i*)(second + offset));
+        uint32_t changedBytes = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xFFFF;
+        while (changedBytes)
+        {
+            const size_t changedElement = (offset + CountTrailingZeros64(changedBytes)) / elementSize;
+            changedMask[changedElement / 64] |= 1ull << (changedElement % 64);
+            // the rest of that element's bytes don't tell us anything new
+            const size_t elementEnd = (changedElement + 1) * elementSize;
+            if (elementEnd >= offset + 16)
+            {
+                break;
+            }
+            changedBytes &= ~0u << (elementEnd - offset);
+        }
+    }
+    // whatever is left is less than a vector, starting with the element that straddles the last one
+    element = offset / elementSize;
+#endif
+    for (; element < elementCount; element++)
+    {
+        if (memcmp(first + element * elementSize, second + element * elementSize, elementSize) != 0)
+        {
+            changedMask[element / 64] |= 1ull << (element % 64);
+        }
+    }
+}
+
+bool AreElementsSame(FieldCompareFn compare, size_t elementSize, const char* first, size_t firstCount, const char* second, size_t secondCount)
+{
+    if (firstCount != secondCount)
+    {
+        return false;
+    }
+    if (compare == CompareBytes || elementSize == 0)
+    {
+        // no need to go element by element for a plain byte compare
+        return CompareBytes(first, second, firstCount * elementSize);
+    }
+    for (size_t offset = 0; offset < firstCount * elementSize; offset += elementSize)
+    {
+        if (!compare(first + offset, second + offset, elementSize))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 0 (and says why) if field's size isn't a whole number of elements
+static size_t GetArrayElementSize(const FieldData& field)
+{
+    const size_t elementCount = field.elementCount;
+    const size_t elementSize = elementCount ? field.size / elementCount : 0;
+    if (!elementSize || elementSize * elementCount != field.size)
+    {
+        printf("field %s is an array of %zu elements, but is %zu bytes. Can't merge it element-wise\n", field.name, elementCount, field.size);
+        return 0;
+    }
+    return elementSize;
+}
+
+bool MergeArrayField(const FieldData& field, FieldCompareFn compare, const char* base, const char* local, const char* remote, char* merged)
+{
+    const size_t elementSize = GetArrayElementSize(field);
+    return elementSize && MergeArrayElements(field.name, compare, elementSize, field.elementCount, base, local, remote, merged);
+}
+
+bool MergeArrayFieldN(const FieldData& field, FieldCompareFn compare, const char* base, const char* const* revisions, size_t revisionCount, char* merged)
+{
+    const size_t elementSize = GetArrayElementSize(field);
+    return elementSize && MergeArrayElementsN(field.name, compare, elementSize, field.elementCount, base, revisions, revisionCount, merged);
+}
+
+bool MergeArrayElements(
+    const char* name, FieldCompareFn compare, size_t elementSize, size_t elementCount,
+    const char* base, const char* local, const char* remote, char* merged)
+{
+    const size_t maskWords = (elementCount + 63) / 64;
+    std::vector<uint64_t> localChanges(maskWords);
+    std::vector<uint64_t> remoteChanges(maskWords);
+    DiffArrayElements(base, local, elementSize, elementCount, localChanges.data());
+    DiffArrayElements(base, remote, elementSize, elementCount, remoteChanges.data());
+
+    // merged starts as local, so elements only local changed (or nobody changed) are already right.
+    // Elements only remote changed get copied over, and elements both changed need to agree.
+    bool result = true;
+    for (size_t word = 0; word < maskWords; word++)
+    {
+        uint64_t remoteOnly = remoteChanges[word] & ~localChanges[word];
+        uint64_t both = remoteChanges[word] & localChanges[word];
+        while (remoteOnly)
+        {
+            size_t offset = (word * 64 + CountTrailingZeros64(remoteOnly)) * elementSize;
+            memcpy(merged + offset, remote + offset, elementSize);
+            remoteOnly &= remoteOnly - 1;
+        }
+        while (both)
+        {
+            // both sides touched the bytes, but that doesn't mean both changed the value (-0.0 for 0.0),
+            // so this is the same decision as for a scalar field, with the element's kernel
+            size_t element = word * 64 + CountTrailingZeros64(both);
+            size_t offset = element * elementSize;
+            bool baseToLocal = compare(base + offset, local + offset, elementSize);
+            bool baseToRemote = compare(base + offset, remote + offset, elementSize);
+            bool localToRemote = !baseToLocal && !baseToRemote && compare(local + offset, remote + offset, elementSize);
+            switch (ResolveModification(baseToLocal, baseToRemote, localToRemote))
+            {
+                case MergeDecision::TAKE_BASE: break; // merged is local, which is the same value
+                case MergeDecision::TAKE_LOCAL: break;
+                case MergeDecision::TAKE_REMOTE:
+                {
+                    memcpy(merged + offset, remote + offset, elementSize);
+                } break;
+                case MergeDecision::CONFLICT:
+                {
+                    printf("conflict in field %s[%zu]\n", name, element);
+                    result = false;
+                } break;
+            }
+            both &= both - 1;
+        }
+    }
+    return result;
+}
+
+bool MergeArrayElementsN(
+    const char* name, FieldCompareFn compare, size_t elementSize, size_t elementCount,
+    const char* base, const char* const* revisions, size_t revisionCount, char* merged)
+{
+    const size_t maskWords = (elementCount + 63) / 64;
+    std::vector<uint64_t> changes(maskWords * revisionCount);
+    for (size_t r = 0; r < revisionCount; r++)
+    {
+        DiffArrayElements(base, revisions[r], elementSize, elementCount, changes.data() + r * maskWords);
+    }
+
+    bool result = true;
+    for (size_t word = 0; word < maskWords; word++)
+    {
+        // which elements somebody changed, and which ones more than one revision changed
+        uint64_t changed = 0;
+        uint64_t several = 0;
+        for (size_t r = 0; r < revisionCount; r++)
+        {
+            const uint64_t mask = changes[r * maskWords + word];
+            several |= changed & mask;
+            changed |= mask;
+        }
+        // merged is revisions[0] already, so anything it changed is in place
+        uint64_t pending = changed & ~changes[word];
+        while (pending)
+        {
+            const uint64_t bit = pending & (0 - pending);
+            const size_t element = word * 64 + CountTrailingZeros64(pending);
+            const size_t offset = element * elementSize;
+            size_t winner = 0;
+            while (!(changes[winner * maskWords + word] & bit))
+            {
+                winner++;
+            }
+            memcpy(merged + offset, revisions[winner] + offset, elementSize);
+            pending &= pending - 1;
+        }
+        while (several)
+        {
+            const uint64_t bit = several & (0 - several);
+            const size_t element = word * 64 + CountTrailingZeros64(several);
+            const size_t offset = element * elementSize;
+            // only revisions whose value actually differs from base (by the kernel, not the bytes) changed it
+            const char* winner = nullptr;
+            for (size_t r = 0; r < revisionCount; r++)
+            {
+                if (!(changes[r * maskWords + word] & bit) || compare(base + offset, revisions[r] + offset, elementSize))
+                {
+                    continue;
+                }
+                if (!winner)
+                {
+                    winner = revisions[r];
+                }
+                else if (!compare(winner + offset, revisions[r] + offset, elementSize))
+                {
+                    printf("conflict in field %s[%zu]: revision %zu disagrees\n", name, element, r);
+                    result = false;
+                    break;
+                }
+            }
+            if (winner)
+            {
+                memcpy(merged + offset, winner + offset, elementSize);
+            }
+            several &= several - 1;
+        }
+    }
+    return result;
+}
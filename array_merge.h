@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "compare_kernels.h"
+#include "format_layout.h"
+
+
+// ARRAY fields are merged per element instead of as one opaque value, so two people editing
+// different entries of the same lookup table don't conflict.
+
+// sets bit i of changedMask if element i differs between first and second.
+// changedMask needs (elementCount + 63) / 64 words. This is a raw byte diff, so -0.0 vs 0.0 shows up as a change.
+// The merges below only use it to find candidates: an element both sides touched is compared against base
+// with the element's kernel, and only a real change on both sides can conflict.
+void DiffArrayElements(const char* first, const char* second, size_t elementSize, size_t elementCount, uint64_t* changedMask);
+
+// whole runs of elements as one value (a variable length field someone resized, say): the same if they have
+// the same number of elements and compare agrees on every one of them
+bool AreElementsSame(FieldCompareFn compare, size_t elementSize, const char* first, size_t firstCount, const char* second, size_t secondCount);
+
+// merges one ARRAY field. Pointers are to the start of the field in each revision,
+// and merged must already hold local's copy of the field.
+// compare is the element's kernel (see SelectCompareKernels), used for elements both sides changed.
+// Returns false if any element was changed differently on both sides
+bool MergeArrayField(const FieldData& field, FieldCompareFn compare, const char* base, const char* local, const char* remote, char* merged);
+// same thing for a run of elements that isn't described by a single FieldData (like a variable length field).
+// name is only used for reporting conflicts
+bool MergeArrayElements(
+    const char* name, FieldCompareFn compare, size_t elementSize, size_t elementCount,
+    const char* base, const char* local, const char* remote, char* merged);
+// N-way versions: one base and revisionCount revisions. merged must already hold revisions[0]'s copy.
+// An element changed by one revision takes that revision's value. Changed by several, they all have to agree,
+// otherwise it's a conflict and the first revision that changed it wins
+bool MergeArrayFieldN(const FieldData& field, FieldCompareFn compare, const char* base, const char* const* revisions, size_t revisionCount, char* merged);
+bool MergeArrayElementsN(
+    const char* name, FieldCompareFn compare, size_t elementSize, size_t elementCount,
+    const char* base, const char* const* revisions, size_t revisionCount, char* merged);
@@ -1,75 +1,32 @@
+#include <algorithm>
 #include <assert.h>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
 
 #include <set>
+#include <string>
+#include <vector>
 
-#include "type_enumeration.h"
+#include "array_merge.h"
+#include "bitfield_merge.h"
+#include "compare_kernels.h"
+#include "container.h"
+#include "file_index.h"
+#include "format_layout.h"
+#include "format_registry.h"
+#include "merge_decision.h"
+#include "migrate.h"
+#include "octopus_merge.h"
+#include "output_writer.h"
+#include "sparse_file.h"
+#include "three_way_merge.h"
+#include "pdb/mapped_file.h"
 
 
-// since we are merging at the "field granularity", we will never
-// need to do an intelligent merge inside of a field itself. (unless maybe the field is itself another structure?)
-// For that reason, we can treat any field as being uniquely identified by it's name (and size).
-// then, the data for the field is just an opaque sized buffer
-constexpr uint32_t INVALID_FIELD_INDEX = UINT32_MAX;
-struct FieldData
-{
-    size_t size = 0; // size 0 means "empty field"
-    char* data = nullptr;
-    #define MAX_IDENTIFIER_LENGTH (2048) // this is the actual *max* for most compilers, reasonably, it could be smaller
-    char name[MAX_IDENTIFIER_LENGTH] = {0};
-};
-bool AreFieldsSame(const FieldData* first, const FieldData* second)
-{
-    return first->size == second->size && strncmp(first->name, second->name, MAX_IDENTIFIER_LENGTH) == 0;
-}
-bool IsFieldEmpty(const FieldData* field)
-{
-    return field->size == 0;
-}
-
-struct FormatLayout
-{
-    uint32_t magic = 0;
-    size_t fieldsCount = 0;
-    FieldData* fields;
-};
-size_t GetStructureSize(FormatLayout* layout)
-{
-    size_t result = 0;
-    for (size_t i = 0; i < layout->fieldsCount; i++)
-    {
-        result += layout->fields[i].size;
-    }
-    return result;
-}
-const FieldData* DoesFormatHaveField(const FormatLayout* layout, const FieldData* field, uint32_t* fieldIndexOut = nullptr)
-{
-    FieldData* result = nullptr;
-    for (int i = 0; i < layout->fieldsCount; i++)
-    {
-        if (AreFieldsSame(&layout->fields[i], field))
-        {
-            if (fieldIndexOut) { *fieldIndexOut = i; }
-            return &layout->fields[i];
-        }
-    }
-    return result;
-}
-void PrintMe(FormatLayout* layout)
-{
-    printf("magic: %u", layout->magic);
-    printf("num fields: %zu", layout->fieldsCount);
-    for (int i = 0; i < layout->fieldsCount; i++)
-    {
-        printf("field: %s\n", layout->fields[i].name);
-        printf("size: %zu", layout->fields[i].size);
-        printf("data as str: %.*s\n", (int)layout->fields[i].size, layout->fields[i].data);
-    }
-}
-
 // -----------------------------
 // EXAMPLE HARDCODED TYPE
 struct Vector3
@@ -90,7 +47,7 @@ void PrintMe(ExampleFileFormat* fileformat)
     printf("x = %i\n", fileformat->x);
     printf("pos = %f %f %f\n", fileformat->pos.x, fileformat->pos.y, fileformat->pos.z);
     printf("name = %s\n", fileformat->name);
-    printf("counter = %I64u\n", fileformat->counter);
+    printf("counter = %llu\n", (unsigned long long)fileformat->counter);
 }
 
 static FormatLayout ExampleFileFormatHardcodedMetadata =
@@ -101,103 +58,283 @@ static FormatLayout ExampleFileFormatHardcodedMetadata =
     {
         {
             .size = sizeof(ExampleFileFormat::x),
-            //Types::INTEGER,
+            .offset = offsetof(ExampleFileFormat, x),
+            .type = INTEGER,
             .name = "x",
         },
         {
             .size = sizeof(ExampleFileFormat::pos),
-            //Types::STRUCTURE,
+            .offset = offsetof(ExampleFileFormat, pos),
+            .type = STRUCTURE,
             .name = "pos",
         },
         {
             .size = sizeof(ExampleFileFormat::name),
-            //Types::CSTRING,
+            .offset = offsetof(ExampleFileFormat, name),
+            .type = CSTRING,
             .name = "name",
         },
         {
             .size = sizeof(ExampleFileFormat::counter),
-            //Types::LONG,
+            .offset = offsetof(ExampleFileFormat, counter),
+            .type = LONG,
             .name = "counter",
         }
     },
 };
-// ----------------------------
 
-/* 
-https://homes.cs.washington.edu/~mernst/pubs/merge-evaluation-ase2024.pdf
-The resolution phase of three-way merging uses the following
-algorithm. For each change C in a 3-way diff, let C1 be the difference
-between the base and parent 1 and let C2 be the difference between
-the base and parent 2. C1 and C2 are at the same location in the
-source code.
-• If C1 is the same as C2, use it; equivalently, if parent 1 is the
-same as parent 2, use it.
-• If C1 is empty, use C2; equivalently, if the base is the same as
-parent 1, use parent 2.
-• If C2 is empty, use C1; equivalently, if the base is the same as
-parent 2, use parent 1.
-• If C1 differs from C2, report a conflict; equivalently, if the base,
-parent 1, and parent 2 all differ, report a conflict.
-// TODO: make sure im covering each of these cases...
-*/
-
-// logic for handling a modification merge at the finest granularity (a single struct field)
-bool AtomicMergeModificationResult(
-    const FieldData& base, 
-    const FieldData& local, // "parent 1"
-    const FieldData& remote,  // "parent 2"
-    FieldData& merged)
-{
-    // TODO: this isn't complete yet
-    // first: clean up data comparison logic using above comment
-    // do proper merge logic for the *names* of these fields too
-
-    // assuming these are all the same size, which is an incorrect assumption....
-#define COMPARE(one, two) (one.size == two.size && memcmp(&one.data, &two.data, one.size) == 0)
-    bool baseToLocal = COMPARE(base, local);
-    bool baseToRemote = COMPARE(base, remote);
-    if (baseToLocal && baseToRemote)
-    {
-        // no changes
-        merged = base;
-    }
-    bool localToRemote = COMPARE(local, remote);
-    if (localToRemote)
-    {
-        // same change, return that change
-        merged = local;
-    }
-    if (baseToLocal && !baseToRemote)
-    {
-        // base is same as local, but remote has different changes, so we merge remote changes here
-        merged = remote;
-    }
-    if (!baseToLocal && baseToRemote)
-    {
-        // local differs from base, but remote is same, merge in local
-        merged = local;
-    }
-    if (!baseToLocal && !baseToRemote && !localToRemote)
-    {
-        // both local and remote have made *different* changes, this is a merge conflict
-        return false;
-    }
-    return true;
-}
+// the same format after a schema change: "x" was removed, "counter" moved up, and "scale" was added.
+// The magic is bumped so a migration can tell old files from ones that were already migrated.
+struct ExampleFileFormatV2
+{
+    uint32_t magic = 0xDEADBEF0;
+    Vector3 pos;
+    uint64_t counter;
+    char name[20];
+    float scale;
+};
+static float ExampleFileFormatV2DefaultScale = 1.0f;
+static FormatLayout ExampleFileFormatV2HardcodedMetadata =
+{
+    .magic = 0xDEADBEF0,
+    .fieldsCount = 4,
+    .fields = new FieldData[]
+    {
+        {
+            .size = sizeof(ExampleFileFormatV2::pos),
+            .offset = offsetof(ExampleFileFormatV2, pos),
+            .type = STRUCTURE,
+            .name = "pos",
+        },
+        {
+            .size = sizeof(ExampleFileFormatV2::counter),
+            .offset = offsetof(ExampleFileFormatV2, counter),
+            .type = LONG,
+            .name = "counter",
+        },
+        {
+            .size = sizeof(ExampleFileFormatV2::name),
+            .offset = offsetof(ExampleFileFormatV2, name),
+            .type = CSTRING,
+            .name = "name",
+        },
+        {
+            .size = sizeof(ExampleFileFormatV2::scale),
+            .offset = offsetof(ExampleFileFormatV2, scale),
+            .type = FLOAT,
+            .data = (char*)&ExampleFileFormatV2DefaultScale,
+            .name = "scale",
+        }
+    },
+};
+
+// Vector3's own layout. Structures that point their Vector3 fields at it get merged per component
+static FormatLayout Vector3HardcodedMetadata =
+{
+    .fieldsCount = 3,
+    .fields = new FieldData[]
+    {
+        {
+            .size = sizeof(Vector3::x),
+            .offset = offsetof(Vector3, x),
+            .type = FLOAT,
+            .name = "x",
+        },
+        {
+            .size = sizeof(Vector3::y),
+            .offset = offsetof(Vector3, y),
+            .type = FLOAT,
+            .name = "y",
+        },
+        {
+            .size = sizeof(Vector3::z),
+            .offset = offsetof(Vector3, z),
+            .type = FLOAT,
+            .name = "z",
+        }
+    },
+};
 
+// a mesh header, followed by its index buffer and then a pool of names:
+// ExampleMeshFormat, indexCount uint16_t indices, namesSize bytes of names.
+// nameOffset is where this mesh's own name starts in the pool
+struct ExampleMeshFormat
+{
+    uint32_t magic = 0xDEADBEF1;
+    Vector3 bounds;
+    float lodDistances[4];
+    uint32_t indexCount;
+    uint32_t namesSize;
+    uint32_t nameOffset;
+};
+static FormatLayout ExampleMeshFormatHardcodedMetadata =
+{
+    .magic = 0xDEADBEF1,
+    .fieldsCount = 7,
+    .fields = new FieldData[]
+    {
+        {
+            .size = sizeof(ExampleMeshFormat::bounds),
+            .offset = offsetof(ExampleMeshFormat, bounds),
+            .type = STRUCTURE,
+            .data = (char*)&Vector3HardcodedMetadata,
+            .name = "bounds",
+        },
+        {
+            .size = sizeof(ExampleMeshFormat::lodDistances),
+            .offset = offsetof(ExampleMeshFormat, lodDistances),
+            .type = ARRAY,
+            .elementType = FLOAT,
+            .elementCount = 4,
+            .name = "lodDistances",
+        },
+        {
+            .size = sizeof(ExampleMeshFormat::indexCount),
+            .offset = offsetof(ExampleMeshFormat, indexCount),
+            .type = INTEGER,
+            .name = "indexCount",
+        },
+        {
+            .size = sizeof(ExampleMeshFormat::namesSize),
+            .offset = offsetof(ExampleMeshFormat, namesSize),
+            .type = INTEGER,
+            .name = "namesSize",
+        },
+        {
+            .size = sizeof(ExampleMeshFormat::nameOffset),
+            .offset = offsetof(ExampleMeshFormat, nameOffset),
+            .type = INTEGER,
+            .targetField = 6, // names
+            .name = "nameOffset",
+        },
+        {
+            .size = sizeof(uint16_t),
+            .type = SHORT,
+            .countField = 2, // indexCount
+            .name = "indices",
+        },
+        {
+            .size = 1,
+            .type = SIZEDBUFFER,
+            .countField = 3, // namesSize
+            .name = "names",
+        }
+    },
+};
+
+// render flags packed into one uint32_t, the way engines usually store them:
+// bit 0 visible, bit 1 castsShadow, bits 2-4 lodBias, bits 5-9 layer
+struct ExampleFlagsFormat
+{
+    uint32_t magic = 0xDEADBEF2;
+    uint32_t flags;
+    uint32_t id;
+};
+static FormatLayout ExampleFlagsFormatHardcodedMetadata =
+{
+    .magic = 0xDEADBEF2,
+    .fieldsCount = 5,
+    .fields = new FieldData[]
+    {
+        {
+            .size = sizeof(ExampleFlagsFormat::flags),
+            .offset = offsetof(ExampleFlagsFormat, flags),
+            .type = INTEGER,
+            .bitPosition = 0,
+            .bitWidth = 1,
+            .name = "visible",
+        },
+        {
+            .size = sizeof(ExampleFlagsFormat::flags),
+            .offset = offsetof(ExampleFlagsFormat, flags),
+            .type = INTEGER,
+            .bitPosition = 1,
+            .bitWidth = 1,
+            .name = "castsShadow",
+        },
+        {
+            .size = sizeof(ExampleFlagsFormat::flags),
+            .offset = offsetof(ExampleFlagsFormat, flags),
+            .type = INTEGER,
+            .bitPosition = 2,
+            .bitWidth = 3,
+            .name = "lodBias",
+        },
+        {
+            .size = sizeof(ExampleFlagsFormat::flags),
+            .offset = offsetof(ExampleFlagsFormat, flags),
+            .type = INTEGER,
+            .bitPosition = 5,
+            .bitWidth = 5,
+            .name = "layer",
+        },
+        {
+            .size = sizeof(ExampleFlagsFormat::id),
+            .offset = offsetof(ExampleFlagsFormat, id),
+            .type = INTEGER,
+            .name = "id",
+        }
+    },
+};
+
+// an asset cooked for a big endian console. Every number in the file is byte swapped, the magic too
+struct ExampleConsoleFormat
+{
+    uint32_t magic;
+    float scale;
+    uint16_t boneWeights[4];
+    uint64_t counter;
+};
+static FormatLayout ExampleConsoleFormatHardcodedMetadata =
+{
+    .magic = 0xDEADBEF3,
+    .fieldsCount = 3,
+    .fields = new FieldData[]
+    {
+        {
+            .size = sizeof(ExampleConsoleFormat::scale),
+            .offset = offsetof(ExampleConsoleFormat, scale),
+            .type = FLOAT,
+            .name = "scale",
+        },
+        {
+            .size = sizeof(ExampleConsoleFormat::boneWeights),
+            .offset = offsetof(ExampleConsoleFormat, boneWeights),
+            .type = ARRAY,
+            .elementType = SHORT,
+            .elementCount = 4,
+            .name = "boneWeights",
+        },
+        {
+            .size = sizeof(ExampleConsoleFormat::counter),
+            .offset = offsetof(ExampleConsoleFormat, counter),
+            .type = LONG,
+            .name = "counter",
+        }
+    },
+    .endianness = Endianness::BIG,
+};
+// ----------------------------
 
 // when merging, we require 6 pieces of info
 // base revision, local revision and remote revision
 // each needing the file format layout metadata, and the actual file contents
-// TODO: the "ExampleFileFormat" is temp for testing and iterating. Make it generic in the future
-FormatLayout MergeFormats(
+// the merged file contents go into fileMerged (which needs to be big enough for the fixed part of the layout),
+// and the layout they're in goes into mergedLayout.
+// Returns false if the formats couldn't be merged at all, then neither output means anything.
+// conflictsOut is always set: true if the data merge had to leave any field unresolved, or if there was no merge
+bool MergeFormats(
     const FormatLayout& base, 
     const FormatLayout& local, 
     const FormatLayout& remote,
-    const ExampleFileFormat& fileBase,
-    const ExampleFileFormat& fileLocal,
-    const ExampleFileFormat& fileRemote)
+    const char* fileBase,
+    const char* fileLocal,
+    const char* fileRemote,
+    char* fileMerged,
+    FormatLayout& mergedLayout,
+    bool* conflictsOut = nullptr)
 {
+    if (conflictsOut) { *conflictsOut = true; }
     // we never expect the magic to change. 
     auto magic = base.magic;
     bool localMagicMatch = memcmp(&local.magic, &magic, sizeof(magic)) == 0;
@@ -205,9 +342,20 @@ FormatLayout MergeFormats(
     if (!localMagicMatch || !remoteMagicMatch)
     {
         printf("magic not matching! failed to merge\n");
-        return {};
+        return false;
+    }
+    // by far the most common case: nobody touched the schema, only the data changed.
+    // Fingerprints are computed once at load, so this is just an integer compare
+    // and we can skip all of the structural diffing below
+    if (base.fingerprint && base.fingerprint == local.fingerprint && base.fingerprint == remote.fingerprint)
+    {
+        std::vector<FieldCompareFn> kernels = SelectCompareKernels(base);
+        bool merged = MergeRecordData(base, kernels.data(), fileBase, fileLocal, fileRemote, fileMerged);
+        if (conflictsOut) { *conflictsOut = !merged; }
+        mergedLayout = base;
+        return true;
     }
-    FormatLayout mergedResult = {0};
+
     // here is the meat. Merging arbitrary structures...
 
     // a single "instance" of a field reordering in some revision
@@ -218,6 +366,10 @@ FormatLayout MergeFormats(
         uint32_t originalIdx = INVALID_FIELD_INDEX;
         uint32_t newIdx = INVALID_FIELD_INDEX;
         Reorder(uint32_t ogIdx, uint32_t newIdx) : originalIdx(ogIdx), newIdx(newIdx) {}
+        bool operator<(const Reorder& other) const
+        {
+            return originalIdx != other.originalIdx ? originalIdx < other.originalIdx : newIdx < other.newIdx;
+        }
     };
     // 1 of these per "revision" I.E. local/remote changes
     // EX: unique added fields in local changes from the perspective of the base revision
@@ -255,7 +407,7 @@ FormatLayout MergeFormats(
         {
             const FieldData* baseField = &base.fields[i];
             uint32_t revisionLayoutBaseFieldIndex = INVALID_FIELD_INDEX;
-            const FieldData* baseFieldInRevisionLayout = DoesFormatHaveField(&revisionLayout, baseField, &revisionLayoutBaseFieldIndex);
+            const FieldData* baseFieldInRevisionLayout = DoesFormatHaveField(&revisionLayout, &base, i, &revisionLayoutBaseFieldIndex);
             if (revisionLayoutBaseFieldIndex != i)
             {
                 // if the index of the field in our revision does not match the index
@@ -280,7 +432,7 @@ FormatLayout MergeFormats(
         {
             // to get this, we look through our revision's fields, and if any don't exist in base, they have been added
             const FieldData* revisionField = &revisionLayout.fields[i];
-            const FieldData* revisionFieldInBase = DoesFormatHaveField(&base, revisionField);
+            const FieldData* revisionFieldInBase = DoesFormatHaveField(&base, &revisionLayout, i);
             if (!revisionFieldInBase)
             {
                 revisionDiff.addedFields.insert(revisionField);
@@ -295,46 +447,1335 @@ FormatLayout MergeFormats(
     // mmmm still hazy on next steps... gonna write random crap
     // collect these structural diffs into one merged result layout?
     // then do atomic field merges on all fields in merged layout?
-    const FormatLayout& nativeLayout = local;
-    
-    return mergedResult;
+    (void)baseDiffLocal;
+    (void)baseDiffRemote;
+
+    // until the structural diffs turn into a merged layout, this is as far as we get.
+    // Migrating all three to the same layout first takes the fingerprint path above
+    printf("the revisions use different layouts, which can't be merged yet. Migrate them to the same layout first\n");
+    return false;
 }
 
-// terms:
-// base = original version of the file before changes
-// local = your changes (p4 calls this "target")
-// remote = someone else's changes (being merged against yours) (p4 calls this "source")
-int main(int argc, char* argv[])
+// merges three block-compressed containers (container.h) without unpacking them all.
+// A block that's the same in all three revisions is nobody's change. It stays compressed, and its raw bytes
+// are left zero in all three buffers: zero vs zero vs zero reads as "unchanged" to the merge, same as the real bytes would.
+// Only blocks somebody changed get decompressed, plus any block that shares a field with one of them
+// (half a string in a zeroed block would read as a different string). Variable length layouts move
+// everything around based on counts, so those get unpacked in full.
+// The result reuses local's compressed blocks wherever the merged bytes match, then remote's or base's,
+// and only compresses whatever is left
+bool MergeContainers(const FormatRegistry& registry, const char* const* paths, const char* const* data, const size_t* lens, std::vector<char>& out, bool* conflictsOut)
 {
-    ExampleFileFormat base =
+    Container containers[3];
+    for (int i = 0; i < 3; i++)
     {
-        .x = 10,
-        .pos = Vector3{ 1.0f, 2.0f, 3.0f },
-        .name = "test",
-        .counter = 123
-    };
-    ExampleFileFormat local =
+        if (!OpenContainer(data[i], lens[i], containers[i]))
+        {
+            printf("in %s\n", paths[i]);
+            return false;
+        }
+    }
+    const uint32_t blockSize = containers[1].header.blockSize;
+    if (containers[0].header.blockSize != blockSize || containers[2].header.blockSize != blockSize)
     {
-        .x = 10,
-        .pos = Vector3{ 1.0f, 2.0f, 3.0f },
-        .name = "testlocal",
-        .counter = 123
+        printf("revisions use different block sizes, repack them first\n");
+        return false;
+    }
+    size_t blockCount = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        blockCount = std::max(blockCount, containers[i].blocks.size());
+    }
+    if (blockCount == 0)
+    {
+        printf("containers are empty\n");
+        return false;
+    }
+    std::vector<uint8_t> untouched(blockCount);
+    std::vector<uint8_t> needed(blockCount);
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        untouched[b] = AreBlocksSame(containers[0], containers[1], b) && AreBlocksSame(containers[0], containers[2], b);
+        needed[b] = !untouched[b];
+    }
+    std::vector<char> raws[3];
+    for (int i = 0; i < 3; i++)
+    {
+        raws[i].resize((size_t)containers[i].header.rawSize);
+    }
+    auto decompress = [&](const std::vector<uint8_t>& blocks)
+    {
+        std::vector<BlockJob> jobs = {};
+        for (int i = 0; i < 3; i++)
+        {
+            for (size_t b = 0; b < containers[i].blocks.size(); b++)
+            {
+                if (blocks[b])
+                {
+                    jobs.push_back({ &containers[i], b, raws[i].data() + b * blockSize });
+                }
+            }
+        }
+        return DecompressBlocks(jobs.data(), jobs.size());
     };
-    ExampleFileFormat remote =
+
+    // the first block has the magic, which tells us the layout, which tells us what else has to be decompressed
+    std::vector<uint8_t> first(blockCount);
+    first[0] = 1;
+    if (!decompress(first))
     {
-        .x = 10,
-        .pos = Vector3{ 1.0f, 2.0f, 3.0f },
-        .name = "testremote",
-        .counter = 123
+        return false;
+    }
+    FormatLayout* layouts[3] = {};
+    for (int i = 0; i < 3; i++)
+    {
+        layouts[i] = FindFormatForFile(registry, raws[i].data(), raws[i].size());
+        if (!layouts[i])
+        {
+            printf("no schema registered for %s\n", paths[i]);
+            return false;
+        }
+    }
+    if (layouts[0] != layouts[1] || layouts[0] != layouts[2])
+    {
+        printf("revisions use different schemas, migrate them first\n");
+        return false;
+    }
+    const FormatLayout& layout = *layouts[0];
+    bool fixedOnly = true;
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        fixedOnly = fixedOnly && !IsFieldVariable(&layout.fields[i]);
+    }
+    for (size_t i = 0; i < layout.fieldsCount && fixedOnly; i++)
+    {
+        const FieldData& field = layout.fields[i];
+        if (field.size == 0)
+        {
+            continue;
+        }
+        const size_t firstBlock = field.offset / blockSize;
+        const size_t lastBlock = std::min((field.offset + field.size - 1) / blockSize, blockCount - 1);
+        bool touched = false;
+        for (size_t b = firstBlock; b <= lastBlock && !touched; b++)
+        {
+            touched = !untouched[b];
+        }
+        for (size_t b = firstBlock; b <= lastBlock && touched; b++)
+        {
+            needed[b] = 1;
+        }
+    }
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        needed[b] = (needed[b] || !fixedOnly) && !first[b];
+    }
+    if (!decompress(needed))
+    {
+        return false;
+    }
+
+    std::vector<char> merged = {};
+    if (!MergeFiles(layout, raws[0].data(), raws[0].size(), raws[1].data(), raws[1].size(), raws[2].data(), raws[2].size(), merged, conflictsOut))
+    {
+        return false;
+    }
+
+    std::vector<OutputBlock> blocks((merged.size() + blockSize - 1) / blockSize);
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        const char* raw = merged.data() + b * blockSize;
+        const size_t rawSize = std::min<size_t>(blockSize, merged.size() - b * blockSize);
+        blocks[b] = { nullptr, b, raw, rawSize };
+        if (fixedOnly && b < blockCount && untouched[b] && GetBlockRawSize(containers[1], b) == rawSize)
+        {
+            blocks[b].source = &containers[1];
+            continue;
+        }
+        // local first, since those bytes are already sitting in the file we're about to write over
+        for (int i : { 1, 2, 0 })
+        {
+            if (b < containers[i].blocks.size() && GetBlockRawSize(containers[i], b) == rawSize &&
+                memcmp(raws[i].data() + b * blockSize, raw, rawSize) == 0)
+            {
+                blocks[b].source = &containers[i];
+                break;
+            }
+        }
+    }
+    return WriteContainer(&containers[1], blockSize, merged.size(), blocks, out);
+}
+
+// the three inputs are mapped already. Picks the schema from their magic and merges them.
+// dataRanges is where any of them has data, nullptr to read everything
+bool MergeMappedFiles(const FormatRegistry& registry, const char* const* paths, const char* const* data, const size_t* lens, std::vector<char>& merged, bool* conflictsOut,
+    const std::vector<ByteRange>* dataRanges = nullptr)
+{
+    int containerCount = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        containerCount += IsContainer(data[i], lens[i]) ? 1 : 0;
+    }
+    if (containerCount == 3)
+    {
+        return MergeContainers(registry, paths, data, lens, merged, conflictsOut);
+    }
+    if (containerCount != 0)
+    {
+        printf("can't merge compressed and uncompressed revisions, pack or unpack them first\n");
+        return false;
+    }
+    FormatLayout* layouts[3] = {};
+    for (int i = 0; i < 3; i++)
+    {
+        layouts[i] = FindFormatForFile(registry, data[i], lens[i]);
+        if (!layouts[i])
+        {
+            printf("no schema registered for %s\n", paths[i]);
+            return false;
+        }
+    }
+    if (layouts[0] != layouts[1] || layouts[0] != layouts[2])
+    {
+        printf("revisions use different schemas (magic %08x, %08x, %08x), migrate them first\n",
+            layouts[0]->magic, layouts[1]->magic, layouts[2]->magic);
+        return false;
+    }
+    return MergeFiles(*layouts[0], data[0], lens[0], data[1], lens[1], data[2], lens[2], merged, conflictsOut, dataRanges);
+}
+
+// the actual merge tool that git/p4 call.
+// Exit codes are what they expect: 0 = merged cleanly, 1 = conflicts, 2 = couldn't merge at all.
+// The schema is picked by the magic at the front of the files
+int RunMergeDriver(const FormatRegistry& registry, const char* basePath, const char* localPath, const char* remotePath, const char* resultPath)
+{
+    const char* paths[3] = { basePath, localPath, remotePath };
+    MemoryMappedFile::Handle files[3] = {};
+    const char* data[3] = {};
+    size_t lens[3] = {};
+    bool opened = true;
+    for (int i = 0; i < 3 && opened; i++)
+    {
+        files[i] = MemoryMappedFile::Open(paths[i]);
+        opened = files[i].baseAddress != nullptr;
+        if (!opened)
+        {
+            printf("failed to open %s\n", paths[i]);
+        }
+        data[i] = (const char*)files[i].baseAddress;
+        lens[i] = files[i].len;
+    }
+    // sparse inputs: whatever is a hole in all three never gets read
+    std::vector<ByteRange> fileData[3] = {};
+    std::vector<ByteRange> dataRanges = {};
+    for (int i = 0; i < 3 && opened; i++)
+    {
+        FindDataRanges(files[i], fileData[i]);
+    }
+    UniteDataRanges(fileData, 3, dataRanges);
+
+    std::vector<char> merged = {};
+    bool conflicts = false;
+    bool canMerge = opened && MergeMappedFiles(registry, paths, data, lens, merged, &conflicts, &dataRanges);
+    // the result is mostly local, so only what differs from local actually gets written
+    std::vector<ByteRange> changed = {};
+    if (canMerge)
+    {
+        FindChangedRanges(data[1], lens[1], merged.data(), merged.size(), changed, &fileData[1]);
+    }
+    // the result is often one of the inputs (git writes over %A), so unmap everything before writing
+    for (int i = 0; i < 3; i++)
+    {
+        if (files[i].baseAddress)
+        {
+            MemoryMappedFile::Close(files[i]);
+        }
+    }
+    if (!canMerge || !WriteMergedOutput(localPath, resultPath, merged.data(), merged.size(), changed, &fileData[1]))
+    {
+        return 2;
+    }
+    return conflicts ? 1 : 0;
+}
+
+// N-way version of RunMergeDriver: one base, any number of revisions, merged in one pass (see octopus_merge.h).
+// The changed ranges of the result are written relative to the first revision
+int RunOctopusMerge(const FormatRegistry& registry, const char* basePath, const char* const* revisionPaths, size_t revisionCount, const char* resultPath)
+{
+    std::vector<const char*> paths = { basePath };
+    paths.insert(paths.end(), revisionPaths, revisionPaths + revisionCount);
+    std::vector<MemoryMappedFile::Handle> files(paths.size());
+    auto closeAll = [&]()
+    {
+        for (MemoryMappedFile::Handle& file : files)
+        {
+            if (file.baseAddress)
+            {
+                MemoryMappedFile::Close(file);
+                file.baseAddress = nullptr;
+            }
+        }
     };
+    FormatLayout* layout = nullptr;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        files[i] = MemoryMappedFile::Open(paths[i]);
+        if (!files[i].baseAddress)
+        {
+            printf("failed to open %s\n", paths[i]);
+            closeAll();
+            return 2;
+        }
+        FormatLayout* fileLayout = FindFormatForFile(registry, (const char*)files[i].baseAddress, files[i].len);
+        if (!fileLayout || (layout && fileLayout != layout))
+        {
+            printf(fileLayout ? "%s uses a different schema than the base, migrate it first\n" : "no schema registered for %s\n", paths[i]);
+            closeAll();
+            return 2;
+        }
+        layout = fileLayout;
+    }
 
-    FormatLayout merged = MergeFormats(
-        ExampleFileFormatHardcodedMetadata, 
+    std::vector<const char*> revisions(revisionCount);
+    std::vector<size_t> revisionLens(revisionCount);
+    for (size_t r = 0; r < revisionCount; r++)
+    {
+        revisions[r] = (const char*)files[r + 1].baseAddress;
+        revisionLens[r] = files[r + 1].len;
+    }
+    std::vector<char> merged = {};
+    bool conflicts = false;
+    bool canMerge = MergeFilesN(*layout, (const char*)files[0].baseAddress, files[0].len,
+        revisions.data(), revisionLens.data(), revisionCount, merged, &conflicts);
+    std::vector<ByteRange> changed = {};
+    std::vector<ByteRange> firstData = {};
+    if (canMerge)
+    {
+        FindDataRanges(files[1], firstData);
+        FindChangedRanges(revisions[0], revisionLens[0], merged.data(), merged.size(), changed, &firstData);
+    }
+    closeAll();
+    if (!canMerge || !WriteMergedOutput(revisionPaths[0], resultPath, merged.data(), merged.size(), changed, &firstData))
+    {
+        return 2;
+    }
+    return conflicts ? 1 : 0;
+}
+
+// packs a raw file into a block-compressed container, or unpacks one
+int RunPack(const char* inPath, const char* outPath, bool unpack, uint32_t blockSize)
+{
+    MemoryMappedFile::Handle file = MemoryMappedFile::Open(inPath);
+    if (!file.baseAddress)
+    {
+        printf("failed to open %s\n", inPath);
+        return 2;
+    }
+    std::vector<char> out = {};
+    bool packed = false;
+    if (unpack)
+    {
+        Container container = {};
+        packed = OpenContainer((const char*)file.baseAddress, file.len, container) && UnpackContainer(container, out);
+    }
+    else
+    {
+        packed = PackContainer((const char*)file.baseAddress, file.len, blockSize, out);
+    }
+    MemoryMappedFile::Close(file);
+    FILE* dst = packed ? fopen(outPath, "wb") : nullptr;
+    bool written = dst && fwrite(out.data(), 1, out.size(), dst) == out.size();
+    if (dst)
+    {
+        written = (fclose(dst) == 0) && written;
+    }
+    if (!written)
+    {
+        printf("failed to write %s\n", outPath);
+        return 2;
+    }
+    return 0;
+}
+
+// every layout the merge driver can handle
+static FormatLayout* SchemaBundle[] =
+{
+    &ExampleFileFormatHardcodedMetadata,
+    &ExampleFileFormatV2HardcodedMetadata,
+    &ExampleMeshFormatHardcodedMetadata,
+    &ExampleFlagsFormatHardcodedMetadata,
+    &ExampleConsoleFormatHardcodedMetadata,
+};
+
+// -----------------------------
+// binmerge selftest: small files for the bundled layouts, merged through the registry (and through the merge driver
+// for the checks that need real files) the same way a merge tool invocation would, and checked against what the
+// merge should come up with. Every check is one entry in SelfTestChecks, exit code is the number that failed
+
+// merges files[0..2] (base, local, remote) and checks that it conflicted exactly when expected
+static bool SelfTestMerge(const FormatRegistry& registry, const char* name, const std::vector<char>* files, bool expectConflicts, std::vector<char>& merged)
+{
+    const char* paths[3] = { "base", "local", "remote" };
+    const char* data[3] = { files[0].data(), files[1].data(), files[2].data() };
+    const size_t lens[3] = { files[0].size(), files[1].size(), files[2].size() };
+    bool conflicts = false;
+    if (!MergeMappedFiles(registry, paths, data, lens, merged, &conflicts))
+    {
+        printf("selftest %s: couldn't merge\n", name);
+        return false;
+    }
+    if (conflicts != expectConflicts)
+    {
+        printf("selftest %s: expected %s\n", name, expectConflicts ? "a conflict" : "no conflicts");
+        return false;
+    }
+    return true;
+}
+
+static bool SelfTestExpect(const char* name, const std::vector<char>& merged, const std::vector<char>& expected)
+{
+    if (merged != expected)
+    {
+        printf("selftest %s: merged result isn't what it should be\n", name);
+        return false;
+    }
+    printf("selftest %s: ok\n", name);
+    return true;
+}
+
+// for the checks that are just "this has to fail"
+static bool SelfTestCheck(const char* name, bool ok)
+{
+    printf("selftest %s: %s\n", name, ok ? "ok" : "failed");
+    return ok;
+}
+
+template <typename T>
+static std::vector<char> MakeFile(const T& header)
+{
+    std::vector<char> file(sizeof(T));
+    memcpy(file.data(), &header, sizeof(T));
+    return file;
+}
+
+static bool WriteSelfTestFile(const std::filesystem::path& path, const std::vector<char>& data)
+{
+    FILE* f = fopen(path.string().c_str(), "wb");
+    if (!f)
+    {
+        return false;
+    }
+    bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return (fclose(f) == 0) && written;
+}
+
+static std::vector<char> ReadSelfTestFile(const std::filesystem::path& path)
+{
+    std::vector<char> data = {};
+    FILE* f = fopen(path.string().c_str(), "rb");
+    if (f)
+    {
+        char chunk[4096];
+        for (size_t read = 0; (read = fread(chunk, 1, sizeof(chunk), f)) > 0;)
+        {
+            data.insert(data.end(), chunk, chunk + read);
+        }
+        fclose(f);
+    }
+    return data;
+}
+
+// every bundled layout is found by the magic it's stored with, and a bundle with a magic twice is rejected
+static bool SelfTestRegistry(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    bool ok = registry.count == sizeof(SchemaBundle) / sizeof(SchemaBundle[0]);
+    for (FormatLayout* layout : SchemaBundle)
+    {
+        ok = ok && FindFormatByMagic(registry, GetStoredMagic(layout)) == layout;
+    }
+    FormatLayout twice = ExampleFileFormatHardcodedMetadata;
+    FormatLayout* clash[2] = { &ExampleFileFormatHardcodedMetadata, &twice };
+    FormatRegistry clashing = {};
+    ok = ok && !BuildFormatRegistry(clashing, clash, 2);
+    return SelfTestCheck("registry", ok);
+}
+
+// nothing is merged when a revision has no schema, or the revisions don't all use the same one
+static bool SelfTestSchemaMismatch(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    ExampleFileFormat v1 = {};
+    ExampleFileFormatV2 v2 = {};
+    ExampleFileFormat unknown = {};
+    unknown.magic = 0x12345678;
+    std::vector<char> merged = {};
+    const std::vector<char> unknownFiles[3] = { MakeFile(v1), MakeFile(unknown), MakeFile(v1) };
+    const std::vector<char> mixedFiles[3] = { MakeFile(v1), MakeFile(v1), MakeFile(v2) };
+    bool ok = true;
+    for (const std::vector<char>* files : { unknownFiles, mixedFiles })
+    {
+        const char* paths[3] = { "base", "local", "remote" };
+        const char* data[3] = { files[0].data(), files[1].data(), files[2].data() };
+        const size_t lens[3] = { files[0].size(), files[1].size(), files[2].size() };
+        bool conflicts = false;
+        ok = ok && !MergeMappedFiles(registry, paths, data, lens, merged, &conflicts);
+    }
+    return SelfTestCheck("schema mismatch", ok);
+}
+
+// plain fields of the original example layout: one side's changes each, then both changing the same field
+static bool SelfTestFields(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    ExampleFileFormat base = {};
+    base.x = 10;
+    base.pos = Vector3{ 1.0f, 2.0f, 3.0f };
+    strcpy(base.name, "test");
+    ExampleFileFormat local = base;
+    local.pos.y = 5.0f;
+    ExampleFileFormat remote = base;
+    strcpy(remote.name, "renamed");
+    remote.counter = 7;
+    ExampleFileFormat expected = local;
+    strcpy(expected.name, remote.name);
+    expected.counter = remote.counter;
+
+    std::vector<char> files[3] = { MakeFile(base), MakeFile(local), MakeFile(remote) };
+    std::vector<char> merged = {};
+    if (!SelfTestMerge(registry, "fields", files, false, merged) || !SelfTestExpect("fields", merged, MakeFile(expected)))
+    {
+        return false;
+    }
+    remote.pos.y = 6.0f;
+    files[2] = MakeFile(remote);
+    return SelfTestMerge(registry, "fields conflict", files, true, merged) && SelfTestCheck("fields conflict", true);
+}
+
+// MergeFormats: a fingerprint match merges the data, anything it can't merge yet is an explicit failure
+static bool SelfTestMergeFormats(const FormatRegistry&, const std::filesystem::path&)
+{
+    ExampleFileFormat base = {};
+    ExampleFileFormat local = base;
+    local.x = 1;
+    ExampleFileFormat remote = base;
+    remote.counter = 2;
+    ExampleFileFormat merged = {};
+    FormatLayout mergedLayout = {};
+    bool conflicts = true;
+    const FormatLayout& layout = ExampleFileFormatHardcodedMetadata;
+    bool ok = MergeFormats(layout, layout, layout, (const char*)&base, (const char*)&local, (const char*)&remote, (char*)&merged, mergedLayout, &conflicts)
+        && !conflicts && mergedLayout.fingerprint == layout.fingerprint && merged.x == 1 && merged.counter == 2;
+    // same magic, one field less: a different layout
+    FormatLayout changed = layout;
+    changed.fieldsCount--;
+    FinalizeLayout(&changed);
+    conflicts = false;
+    ok = ok && !MergeFormats(layout, layout, changed, (const char*)&base, (const char*)&local, (const char*)&remote, (char*)&merged, mergedLayout, &conflicts)
+        && conflicts;
+    return SelfTestCheck("merge formats", ok);
+}
+
+// the whole driver on real files: exit code 0 and the merged file for a clean merge, 1 for a conflict
+static bool SelfTestMergeDriver(const FormatRegistry& registry, const std::filesystem::path& scratch)
+{
+    ExampleFileFormat base = {};
+    base.x = 10;
+    base.counter = 123;
+    ExampleFileFormat local = base;
+    local.x = 11;
+    ExampleFileFormat remote = base;
+    remote.counter = 124;
+    ExampleFileFormat expected = local;
+    expected.counter = remote.counter;
+    ExampleFileFormat conflicting = base;
+    conflicting.x = 12;
+
+    const std::filesystem::path basePath = scratch / "driver.base";
+    const std::filesystem::path localPath = scratch / "driver.local";
+    const std::filesystem::path remotePath = scratch / "driver.remote";
+    const std::filesystem::path conflictPath = scratch / "driver.conflict";
+    const std::filesystem::path resultPath = scratch / "driver.result";
+    if (!WriteSelfTestFile(basePath, MakeFile(base)) || !WriteSelfTestFile(localPath, MakeFile(local))
+        || !WriteSelfTestFile(remotePath, MakeFile(remote)) || !WriteSelfTestFile(conflictPath, MakeFile(conflicting)))
+    {
+        return SelfTestCheck("merge driver", false);
+    }
+    if (RunMergeDriver(registry, basePath.string().c_str(), localPath.string().c_str(), remotePath.string().c_str(), resultPath.string().c_str()) != 0
+        || RunMergeDriver(registry, basePath.string().c_str(), localPath.string().c_str(), conflictPath.string().c_str(), resultPath.string().c_str()) != 1)
+    {
+        return SelfTestCheck("merge driver", false);
+    }
+    // the conflicting merge didn't touch local
+    if (ReadSelfTestFile(localPath) != MakeFile(local))
+    {
+        return SelfTestCheck("merge driver", false);
+    }
+    RunMergeDriver(registry, basePath.string().c_str(), localPath.string().c_str(), remotePath.string().c_str(), resultPath.string().c_str());
+    return SelfTestExpect("merge driver", ReadSelfTestFile(resultPath), MakeFile(expected));
+}
+
+// WriteMergedOutput with the result being local (by the same path, a differently spelled one and a hard link)
+// and being another file, existing or not. Local is a few blocks long so a truncated local would show
+static bool SelfTestOutputWriter(const FormatRegistry&, const std::filesystem::path& scratch)
+{
+    std::vector<char> local(3 * 4096 + 100);
+    for (size_t i = 0; i < local.size(); i++)
+    {
+        local[i] = (char)(i * 7 + 1);
+    }
+    std::vector<char> merged = local;
+    merged[5000] ^= 0x55;
+    merged.insert(merged.end(), 50, 'x');
+    std::vector<ByteRange> changed = {};
+    FindChangedRanges(local.data(), local.size(), merged.data(), merged.size(), changed);
+
+    const std::filesystem::path localPath = scratch / "writer.local";
+    const std::filesystem::path linkPath = scratch / "writer.link";
+    const std::filesystem::path otherPath = scratch / "writer.other";
+    const std::filesystem::path newPath = scratch / "writer.new";
+    struct Case
+    {
+        const char* name;
+        std::string resultPath;
+        bool isLocal;
+    };
+    const Case cases[] =
+    {
+        { "output in place", localPath.string(), true },
+        { "output aliased", (scratch / "." / "writer.local").string(), true },
+        { "output hard link", linkPath.string(), true },
+        { "output other file", otherPath.string(), false },
+        { "output new file", newPath.string(), false },
+    };
+    bool ok = true;
+    for (const Case& c : cases)
+    {
+        std::error_code error;
+        std::filesystem::remove(linkPath, error);
+        std::filesystem::remove(newPath, error);
+        if (!WriteSelfTestFile(localPath, local) || !WriteSelfTestFile(otherPath, std::vector<char>(10, 'o')))
+        {
+            return SelfTestCheck(c.name, false);
+        }
+        std::filesystem::create_hard_link(localPath, linkPath, error);
+        if (error && c.resultPath == linkPath.string())
+        {
+            // not every filesystem has them
+            continue;
+        }
+        bool written = WriteMergedOutput(localPath.string().c_str(), c.resultPath.c_str(), merged.data(), merged.size(), changed);
+        bool right = written && ReadSelfTestFile(c.resultPath) == merged && ReadSelfTestFile(localPath) == (c.isLocal ? merged : local);
+        ok = SelfTestCheck(c.name, right) && ok;
+    }
+    // and no temporary files left behind
+    size_t fileCount = 0;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(scratch))
+    {
+        fileCount += entry.path().filename().string().rfind("writer.", 0) == 0 ? 1 : 0;
+    }
+    return SelfTestCheck("output leaves no temporary files", fileCount == 4) && ok;
+}
+
+// a sparse local: the merge result written next to it keeps local's holes, and a region the merge zeroes
+// becomes a hole too. Only the contents are checked where the filesystem doesn't do holes
+static bool SelfTestSparseOutput(const FormatRegistry&, const std::filesystem::path& scratch)
+{
+    // data, five regions of hole, data. Regions are bigger than any filesystem block we'd run into
+    const size_t region = 64 * 1024;
+    const std::filesystem::path localPath = scratch / "sparse.local";
+    const std::filesystem::path resultPath = scratch / "sparse.result";
+    std::vector<char> local(7 * region, 0);
+    std::fill(local.begin(), local.begin() + region, 'l');
+    std::fill(local.end() - region, local.end(), 'l');
+    if (!WriteSelfTestFile(localPath, std::vector<char>(local.begin(), local.begin() + region)))
+    {
+        return SelfTestCheck("sparse output", false);
+    }
+    std::error_code error;
+    std::filesystem::resize_file(localPath, 6 * region, error);
+    FILE* f = fopen(localPath.string().c_str(), "ab");
+    bool written = !error && f && fwrite(local.data() + 6 * region, 1, region, f) == region;
+    written = f && (fclose(f) == 0) && written;
+    if (!written)
+    {
+        return SelfTestCheck("sparse output", false);
+    }
+    // the merge writes into one of the holes and zeroes the last region
+    std::vector<char> merged = local;
+    std::fill(merged.begin() + 3 * region, merged.begin() + 3 * region + 100, 'm');
+    std::fill(merged.end() - region, merged.end(), 0);
+
+    std::vector<ByteRange> localData = {};
+    std::vector<ByteRange> changed = {};
+    MemoryMappedFile::Handle localFile = MemoryMappedFile::Open(localPath.string().c_str());
+    if (!localFile.baseAddress)
+    {
+        return SelfTestCheck("sparse output", false);
+    }
+    FindDataRanges(localFile, localData);
+    FindChangedRanges((const char*)localFile.baseAddress, localFile.len, merged.data(), merged.size(), changed, &localData);
+    bool ok = CompareSparse((const char*)localFile.baseAddress, local.data(), 0, local.size(), localData);
+    MemoryMappedFile::Close(localFile);
+    ok = ok && WriteMergedOutput(localPath.string().c_str(), resultPath.string().c_str(), merged.data(), merged.size(), changed, &localData)
+        && ReadSelfTestFile(resultPath) == merged;
+
+    // where local really has holes, the result has to have them in the same places, plus the zeroed region
+    const bool dense = !IsAllHole(localData, region, region);
+    if (ok && !dense)
+    {
+        std::vector<ByteRange> resultData = {};
+        MemoryMappedFile::Handle resultFile = MemoryMappedFile::Open(resultPath.string().c_str());
+        ok = resultFile.baseAddress != nullptr;
+        if (ok)
+        {
+            FindDataRanges(resultFile, resultData);
+            MemoryMappedFile::Close(resultFile);
+        }
+        ok = ok && IsAllHole(resultData, region, 2 * region) && IsAllHole(resultData, 4 * region, 2 * region)
+            && !IsAllHole(resultData, 3 * region, region) && IsAllHole(resultData, 6 * region, region);
+    }
+    return SelfTestCheck(dense ? "sparse output (no holes on this filesystem)" : "sparse output", ok);
+}
+
+static std::vector<char> MakeMeshFile(const ExampleMeshFormat& header, const std::vector<uint16_t>& indices, const char* names, size_t namesSize)
+{
+    ExampleMeshFormat fixed = header;
+    fixed.indexCount = (uint32_t)indices.size();
+    fixed.namesSize = (uint32_t)namesSize;
+    const size_t extent = GetLayoutExtent(&ExampleMeshFormatHardcodedMetadata);
+    std::vector<char> file(extent + indices.size() * sizeof(uint16_t) + namesSize);
+    memcpy(file.data(), &fixed, extent);
+    memcpy(file.data() + extent, indices.data(), indices.size() * sizeof(uint16_t));
+    memcpy(file.data() + extent + indices.size() * sizeof(uint16_t), names, namesSize);
+    return file;
+}
+
+static const char SelfTestMeshNames[] = "rock\0stone";
+
+static ExampleMeshFormat MakeMeshHeader()
+{
+    ExampleMeshFormat header = {};
+    header.lodDistances[0] = 10.0f;
+    header.lodDistances[1] = 20.0f;
+    header.lodDistances[2] = 40.0f;
+    header.lodDistances[3] = 80.0f;
+    header.nameOffset = 5;
+    return header;
+}
+
+// arrays merge per element: different lod distances merge, the same one changed two ways conflicts
+static bool SelfTestArray(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    ExampleMeshFormat base = MakeMeshHeader();
+    ExampleMeshFormat local = base;
+    local.lodDistances[1] = 25.0f;
+    ExampleMeshFormat remote = base;
+    remote.lodDistances[3] = 100.0f;
+    ExampleMeshFormat expected = local;
+    expected.lodDistances[3] = 100.0f;
+    auto make = [](const ExampleMeshFormat& header) { return MakeMeshFile(header, { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames)); };
+    std::vector<char> files[3] = { make(base), make(local), make(remote) };
+    std::vector<char> merged = {};
+    if (!SelfTestMerge(registry, "array", files, false, merged) || !SelfTestExpect("array", merged, make(expected)))
+    {
+        return false;
+    }
+    remote.lodDistances[1] = 30.0f;
+    files[2] = make(remote);
+    return SelfTestMerge(registry, "array conflict", files, true, merged) && SelfTestCheck("array conflict", true);
+}
+
+// variable length fields and an offset into one of them: local grows the index buffer while remote renames the mesh
+// in the pool. Then local points the name somewhere else in the pool while remote rewrites the pool under it
+static bool SelfTestVariable(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    static const char remoteNames[] = "rock\0pebble";
+    const ExampleMeshFormat base = MakeMeshHeader();
+    std::vector<char> files[3] =
+    {
+        MakeMeshFile(base, { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames)),
+        MakeMeshFile(base, { 0, 1, 2, 2, 3, 0 }, SelfTestMeshNames, sizeof(SelfTestMeshNames)),
+        MakeMeshFile(base, { 0, 1, 2 }, remoteNames, sizeof(remoteNames)),
+    };
+    std::vector<char> merged = {};
+    if (!SelfTestMerge(registry, "variable", files, false, merged)
+        || !SelfTestExpect("variable", merged, MakeMeshFile(base, { 0, 1, 2, 2, 3, 0 }, remoteNames, sizeof(remoteNames))))
+    {
+        return false;
+    }
+
+    ExampleMeshFormat local = base;
+    local.nameOffset = 0;
+    files[1] = MakeMeshFile(local, { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames));
+    files[2] = MakeMeshFile(base, { 0, 1, 2 }, "rock\0slate", sizeof(SelfTestMeshNames));
+    return SelfTestMerge(registry, "offset conflict", files, true, merged) && SelfTestCheck("offset conflict", true);
+}
+
+// nested layouts merge per member: each side moving a different member of bounds merges, both moving the same one conflicts
+static bool SelfTestNested(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    ExampleMeshFormat base = MakeMeshHeader();
+    ExampleMeshFormat local = base;
+    local.bounds.x = 1.0f;
+    ExampleMeshFormat remote = base;
+    remote.bounds.y = 2.0f;
+    ExampleMeshFormat expected = local;
+    expected.bounds.y = 2.0f;
+    auto make = [](const ExampleMeshFormat& header) { return MakeMeshFile(header, { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames)); };
+    std::vector<char> files[3] = { make(base), make(local), make(remote) };
+    std::vector<char> merged = {};
+    if (!SelfTestMerge(registry, "nested", files, false, merged) || !SelfTestExpect("nested", merged, make(expected)))
+    {
+        return false;
+    }
+    remote.bounds.x = 3.0f;
+    files[2] = make(remote);
+    return SelfTestMerge(registry, "nested conflict", files, true, merged) && SelfTestCheck("nested conflict", true);
+}
+
+static std::vector<char> MakeFlagsFile(uint32_t visible, uint32_t castsShadow, uint32_t lodBias, uint32_t layer)
+{
+    ExampleFlagsFormat fixed = {};
+    fixed.flags = visible | castsShadow << 1 | lodBias << 2 | layer << 5;
+    fixed.id = 42;
+    std::vector<char> file(GetLayoutExtent(&ExampleFlagsFormatHardcodedMetadata));
+    memcpy(file.data(), &fixed, file.size());
+    return file;
+}
+
+// bitfields sharing one storage unit
+static bool SelfTestFlags(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    // three different flags in the same uint32_t, none of them the same one
+    std::vector<char> files[3] =
+    {
+        MakeFlagsFile(1, 0, 2, 3),
+        MakeFlagsFile(0, 0, 2, 3),
+        MakeFlagsFile(1, 1, 2, 7),
+    };
+    std::vector<char> merged = {};
+    if (!SelfTestMerge(registry, "flags", files, false, merged) || !SelfTestExpect("flags", merged, MakeFlagsFile(0, 1, 2, 7)))
+    {
+        return false;
+    }
+    // both set lodBias, to different values
+    files[1] = MakeFlagsFile(1, 0, 1, 3);
+    files[2] = MakeFlagsFile(1, 0, 4, 3);
+    return SelfTestMerge(registry, "flags conflict", files, true, merged) && SelfTestCheck("flags conflict", true);
+}
+
+// migrate up and back down through a directory: both example files come back the same (x is dropped by V2, so it's
+// 0 to begin with), bytes past the layout ride along, someone else's file is skipped and a truncated one fails
+static bool SelfTestMigrate(const FormatRegistry&, const std::filesystem::path& scratch)
+{
+    const std::filesystem::path directory = scratch / "migrate";
+    std::error_code error;
+    std::filesystem::create_directories(directory / "sub", error);
+    ExampleFileFormat first = {};
+    first.pos = Vector3{ 1.0f, 2.0f, 3.0f };
+    strcpy(first.name, "first");
+    first.counter = 1;
+    ExampleFileFormat second = first;
+    strcpy(second.name, "second");
+    second.counter = 2;
+    std::vector<char> secondFile = MakeFile(second);
+    secondFile.insert(secondFile.end(), { 't', 'a', 'i', 'l' });
+    const std::vector<char> other = MakeMeshFile(MakeMeshHeader(), { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames));
+    if (!WriteSelfTestFile(directory / "first", MakeFile(first)) || !WriteSelfTestFile(directory / "sub" / "second", secondFile)
+        || !WriteSelfTestFile(directory / "other", other) || !WriteSelfTestFile(directory / "broken", std::vector<char>(secondFile.begin(), secondFile.begin() + 8)))
+    {
+        return SelfTestCheck("migrate", false);
+    }
+
+    MigrationPlan up = CompileMigration(ExampleFileFormatHardcodedMetadata, ExampleFileFormatV2HardcodedMetadata);
+    MigrationStats stats = MigrateDirectory(up, directory.string().c_str(), 2);
+    ExampleFileFormatV2 expected = {};
+    expected.pos = first.pos;
+    expected.counter = first.counter;
+    strcpy(expected.name, first.name);
+    expected.scale = ExampleFileFormatV2DefaultScale;
+    bool ok = up.valid && stats.migrated == 2 && stats.skipped == 1 && stats.failed == 1
+        && ReadSelfTestFile(directory / "first") == MakeFile(expected) && ReadSelfTestFile(directory / "other") == other;
+    if (!SelfTestCheck("migrate up", ok))
+    {
+        return false;
+    }
+
+    std::filesystem::remove(directory / "broken", error);
+    MigrationPlan down = CompileMigration(ExampleFileFormatV2HardcodedMetadata, ExampleFileFormatHardcodedMetadata);
+    stats = MigrateDirectory(down, directory.string().c_str(), 2);
+    ok = down.valid && stats.migrated == 2 && stats.skipped == 1 && stats.failed == 0
+        && ReadSelfTestFile(directory / "first") == MakeFile(first) && ReadSelfTestFile(directory / "sub" / "second") == secondFile
+        && ReadSelfTestFile(directory / "other") == other;
+    return SelfTestCheck("migrate down", ok);
+}
+
+// the variable length fields ride along as the tail, so a migration that changes them is refused
+static bool SelfTestMigrateVariable(const FormatRegistry&, const std::filesystem::path&)
+{
+    const FormatLayout& mesh = ExampleMeshFormatHardcodedMetadata;
+    std::vector<FieldData> renamedFields(mesh.fields, mesh.fields + mesh.fieldsCount);
+    std::vector<FieldData> resizedFields = renamedFields;
+    strcpy(renamedFields[5].name, "triangles");
+    resizedFields[5].size = sizeof(uint32_t);
+    resizedFields[5].type = INTEGER;
+    FormatLayout renamed = mesh;
+    renamed.magic = 0xDEADBEF4;
+    renamed.fields = renamedFields.data();
+    FinalizeLayout(&renamed);
+    FormatLayout resized = renamed;
+    resized.fields = resizedFields.data();
+    FinalizeLayout(&resized);
+
+    const std::vector<char> file = MakeMeshFile(MakeMeshHeader(), { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames));
+    std::vector<char> migrated = {};
+    MigrationPlan plans[3] =
+    {
+        CompileMigration(mesh, renamed),
+        CompileMigration(mesh, resized),
+        CompileMigration(ExampleFileFormatHardcodedMetadata, mesh),
+    };
+    bool ok = true;
+    for (const MigrationPlan& plan : plans)
+    {
+        ok = ok && !plan.valid && !ApplyMigration(plan, file.data(), file.size(), migrated);
+    }
+    return SelfTestCheck("migrate refuses changed variable fields", ok);
+}
+
+static std::vector<char> MakeConsoleFile(float scale, const uint16_t* boneWeights, uint64_t counter)
+{
+    const FormatLayout& layout = ExampleConsoleFormatHardcodedMetadata;
+    std::vector<char> file(GetLayoutExtent(&layout));
+    uint32_t scaleBits = 0;
+    memcpy(&scaleBits, &scale, sizeof(scaleBits));
+    WriteUnsignedField(file.data(), sizeof(uint32_t), layout.magic, layout.endianness);
+    WriteUnsignedField(file.data() + offsetof(ExampleConsoleFormat, scale), sizeof(scaleBits), scaleBits, layout.endianness);
+    for (size_t i = 0; i < 4; i++)
+    {
+        WriteUnsignedField(file.data() + offsetof(ExampleConsoleFormat, boneWeights) + i * sizeof(uint16_t), sizeof(uint16_t), boneWeights[i], layout.endianness);
+    }
+    WriteUnsignedField(file.data() + offsetof(ExampleConsoleFormat, counter), sizeof(counter), counter, layout.endianness);
+    return file;
+}
+
+// a big endian layout: found by its swapped magic, and floats compared after swapping them back
+static bool SelfTestConsole(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    const uint16_t baseWeights[4] = { 1, 2, 3, 4 };
+    const uint16_t localWeights[4] = { 9, 2, 3, 4 };
+    const uint16_t remoteWeights[4] = { 1, 2, 3, 8 };
+    const uint16_t mergedWeights[4] = { 9, 2, 3, 8 };
+    // -0.0 is the same scale as 0.0, so local didn't really change it and remote's wins
+    std::vector<char> files[3] =
+    {
+        MakeConsoleFile(0.0f, baseWeights, 10),
+        MakeConsoleFile(-0.0f, localWeights, 10),
+        MakeConsoleFile(5.0f, remoteWeights, 11),
+    };
+    std::vector<char> merged = {};
+    if (!SelfTestMerge(registry, "console", files, false, merged) || !SelfTestExpect("console", merged, MakeConsoleFile(5.0f, mergedWeights, 11)))
+    {
+        return false;
+    }
+    files[1] = MakeConsoleFile(2.0f, baseWeights, 10);
+    files[2] = MakeConsoleFile(3.0f, baseWeights, 10);
+    return SelfTestMerge(registry, "console conflict", files, true, merged) && SelfTestCheck("console conflict", true);
+}
+
+// migrating to a big endian layout swaps every value, members of nested layouts included.
+// A structure without a layout can't be swapped, so that migration is refused instead of copying it unswapped
+static bool SelfTestMigrateEndianness(const FormatRegistry&, const std::filesystem::path&)
+{
+    const FormatLayout& v2 = ExampleFileFormatV2HardcodedMetadata;
+    std::vector<FieldData> fields(v2.fields, v2.fields + v2.fieldsCount);
+    FormatLayout opaque = v2;
+    opaque.magic = 0xDEADBEF5;
+    opaque.endianness = Endianness::BIG;
+    FinalizeLayout(&opaque);
+    // the same, but pos described by Vector3's layout in both
+    std::vector<FieldData> nestedFields = fields;
+    nestedFields[0].data = (char*)&Vector3HardcodedMetadata;
+    FormatLayout nested = v2;
+    nested.fields = nestedFields.data();
+    FinalizeLayout(&nested);
+    FormatLayout nestedBig = opaque;
+    nestedBig.fields = nestedFields.data();
+    FinalizeLayout(&nestedBig);
+
+    ExampleFileFormatV2 file = {};
+    file.pos = Vector3{ 1.0f, 2.0f, 3.0f };
+    file.counter = 0x0102030405060708ull;
+    strcpy(file.name, "big");
+    file.scale = 0.5f;
+    const std::vector<char> src = MakeFile(file);
+    std::vector<char> migrated = {};
+    bool ok = !CompileMigration(v2, opaque).valid;
+    MigrationPlan plan = CompileMigration(nested, nestedBig);
+    ok = ok && plan.valid && ApplyMigration(plan, src.data(), src.size(), migrated) && migrated.size() == src.size();
+    if (ok)
+    {
+        // every number reads back the same in big endian, the string is left alone
+        const float pos[3] = { file.pos.x, file.pos.y, file.pos.z };
+        for (size_t i = 0; i < 3; i++)
+        {
+            uint32_t bits = 0;
+            memcpy(&bits, &pos[i], sizeof(bits));
+            ok = ok && ReadUnsignedField(migrated.data() + offsetof(ExampleFileFormatV2, pos) + i * sizeof(float), sizeof(bits), Endianness::BIG) == bits;
+        }
+        ok = ok && ReadUnsignedField(migrated.data() + offsetof(ExampleFileFormatV2, counter), sizeof(file.counter), Endianness::BIG) == file.counter
+            && memcmp(migrated.data() + offsetof(ExampleFileFormatV2, name), file.name, sizeof(file.name)) == 0;
+    }
+    return SelfTestCheck("migrate to big endian", ok);
+}
+
+// the octopus driver on real files: three revisions with different changes (two of them agreeing on one) merge,
+// and two of them disagreeing conflicts with the first one that changed it winning
+static bool SelfTestOctopus(const FormatRegistry& registry, const std::filesystem::path& scratch)
+{
+    static const char renamed[] = "rock\0pebble";
+    const ExampleMeshFormat base = MakeMeshHeader();
+    ExampleMeshFormat first = base;
+    first.lodDistances[0] = 15.0f;
+    ExampleMeshFormat second = base;
+    second.bounds.x = 1.0f;
+    ExampleMeshFormat third = base;
+    third.lodDistances[0] = 15.0f;
+    ExampleMeshFormat expected = first;
+    expected.bounds.x = 1.0f;
+    const std::vector<uint16_t> grown = { 0, 1, 2, 2, 3, 0 };
+    const std::string revisionPaths[3] = { (scratch / "octopus.1").string(), (scratch / "octopus.2").string(), (scratch / "octopus.3").string() };
+    const std::filesystem::path basePath = scratch / "octopus.base";
+    const std::filesystem::path resultPath = scratch / "octopus.result";
+    const char* revisions[3] = { revisionPaths[0].c_str(), revisionPaths[1].c_str(), revisionPaths[2].c_str() };
+    bool written = WriteSelfTestFile(basePath, MakeMeshFile(base, { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames)))
+        && WriteSelfTestFile(revisionPaths[0], MakeMeshFile(first, { 0, 1, 2 }, SelfTestMeshNames, sizeof(SelfTestMeshNames)))
+        && WriteSelfTestFile(revisionPaths[1], MakeMeshFile(second, grown, SelfTestMeshNames, sizeof(SelfTestMeshNames)))
+        && WriteSelfTestFile(revisionPaths[2], MakeMeshFile(third, { 0, 1, 2 }, renamed, sizeof(renamed)));
+    if (!written || RunOctopusMerge(registry, basePath.string().c_str(), revisions, 3, resultPath.string().c_str()) != 0
+        || !SelfTestExpect("octopus", ReadSelfTestFile(resultPath), MakeMeshFile(expected, grown, renamed, sizeof(renamed))))
+    {
+        return SelfTestCheck("octopus", false);
+    }
+
+    third.lodDistances[0] = 30.0f;
+    ExampleMeshFormat merged = {};
+    const std::vector<char> result = WriteSelfTestFile(revisionPaths[2], MakeMeshFile(third, { 0, 1, 2 }, renamed, sizeof(renamed)))
+        && RunOctopusMerge(registry, basePath.string().c_str(), revisions, 3, resultPath.string().c_str()) == 1 ? ReadSelfTestFile(resultPath) : std::vector<char>();
+    if (result.size() >= sizeof(merged))
+    {
+        memcpy(&merged, result.data(), sizeof(merged));
+    }
+    return SelfTestCheck("octopus conflict", result.size() >= sizeof(merged) && merged.lodDistances[0] == first.lodDistances[0]);
+}
+
+// the N-way merge compares with the same kernels as the three-way one, also where a variable length field was resized:
+// -0.0 where base has 0.0 isn't a change, so the resize merges cleanly.
+// And an ARRAY that isn't a whole number of elements fails the same way in both
+static bool SelfTestOctopusKernels(const FormatRegistry&, const std::filesystem::path&)
+{
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t count;
+    };
+    FieldData valueFields[] =
+    {
+        { .size = sizeof(uint32_t), .offset = offsetof(Header, count), .type = INTEGER, .name = "count" },
+        { .size = sizeof(float), .type = FLOAT, .countField = 0, .name = "values" },
+    };
+    FormatLayout values = { .magic = 0xDEADBEF6, .fieldsCount = 2, .fields = valueFields };
+    FinalizeLayout(&values);
+    auto make = [](std::vector<float> floats)
+    {
+        Header header = { 0xDEADBEF6, (uint32_t)floats.size() };
+        std::vector<char> file = MakeFile(header);
+        file.insert(file.end(), (const char*)floats.data(), (const char*)(floats.data() + floats.size()));
+        return file;
+    };
+    const std::vector<char> base = make({ 0.0f, 1.0f });
+    const std::vector<char> revisionFiles[2] = { make({ -0.0f, 1.0f }), make({ 0.0f, 1.0f, 2.0f }) };
+    const char* revisions[2] = { revisionFiles[0].data(), revisionFiles[1].data() };
+    const size_t revisionLens[2] = { revisionFiles[0].size(), revisionFiles[1].size() };
+    std::vector<char> merged = {};
+    bool conflicts = true;
+    bool ok = MergeFilesN(values, base.data(), base.size(), revisions, revisionLens, 2, merged, &conflicts) && !conflicts && merged == revisionFiles[1];
+
+    // 6 bytes can't be 4 elements
+    FieldData arrayFields[] =
+    {
+        { .size = 6, .offset = sizeof(uint32_t), .type = ARRAY, .elementType = SHORT, .elementCount = 4, .name = "broken" },
+    };
+    FormatLayout broken = { .magic = 0xDEADBEF7, .fieldsCount = 1, .fields = arrayFields };
+    FinalizeLayout(&broken);
+    const std::vector<char> file(12, 0);
+    const char* same[2] = { file.data(), file.data() };
+    const size_t sameLens[2] = { file.size(), file.size() };
+    bool threeWayConflicts = false;
+    conflicts = false;
+    ok = ok && MergeFilesN(broken, file.data(), file.size(), same, sameLens, 2, merged, &conflicts) && conflicts
+        && MergeFiles(broken, file.data(), file.size(), file.data(), file.size(), file.data(), file.size(), merged, &threeWayConflicts) && threeWayConflicts;
+    return SelfTestCheck("octopus kernels", ok);
+}
+
+// containers: pack/unpack round trips with a short last block, and a merge of three packed files where local changes
+// the tail past the layout (and grows it by a block) while remote changes the header. The merged container has
+// to unpack to what merging the raw files gives, with the blocks in between copied over as they were
+static bool SelfTestContainers(const FormatRegistry& registry, const std::filesystem::path&)
+{
+    const uint32_t blockSize = 32;
+    std::vector<char> noise(1000);
+    uint32_t state = 12345;
+    for (char& c : noise)
+    {
+        state = state * 1664525 + 1013904223;
+        c = (char)(state >> 24);
+    }
+    bool ok = true;
+    for (const std::vector<char>& raw : { noise, std::vector<char>(1000, 'z') })
+    {
+        std::vector<char> packed = {};
+        std::vector<char> unpacked = {};
+        Container container = {};
+        ok = ok && PackContainer(raw.data(), raw.size(), blockSize, packed, 3) && OpenContainer(packed.data(), packed.size(), container)
+            && UnpackContainer(container, unpacked, 3) && unpacked == raw && GetBlockRawSize(container, container.blocks.size() - 1) == raw.size() % blockSize;
+    }
+    if (!SelfTestCheck("container round trip", ok))
+    {
+        return false;
+    }
+
+    ExampleFileFormat header = {};
+    header.counter = 1;
+    std::vector<char> raws[3] = { MakeFile(header), MakeFile(header), MakeFile(header) };
+    raws[0].insert(raws[0].end(), noise.begin(), noise.begin() + 200);
+    raws[1] = raws[0];
+    raws[2] = raws[0];
+    raws[1][raws[1].size() - 3] ^= 0x40;
+    raws[1].insert(raws[1].end(), blockSize, 't');
+    ExampleFileFormat remote = header;
+    remote.counter = 2;
+    memcpy(raws[2].data(), &remote, sizeof(remote));
+
+    std::vector<char> packed[3];
+    Container containers[3];
+    for (int i = 0; i < 3; i++)
+    {
+        ok = ok && PackContainer(raws[i].data(), raws[i].size(), blockSize, packed[i]) && OpenContainer(packed[i].data(), packed[i].size(), containers[i]);
+    }
+    std::vector<char> expected = {};
+    std::vector<char> merged = {};
+    std::vector<char> unpacked = {};
+    Container mergedContainer = {};
+    bool conflicts = true;
+    const std::vector<char> packedFiles[3] = { packed[0], packed[1], packed[2] };
+    ok = ok && MergeFiles(ExampleFileFormatHardcodedMetadata, raws[0].data(), raws[0].size(), raws[1].data(), raws[1].size(), raws[2].data(), raws[2].size(), expected, &conflicts)
+        && !conflicts && SelfTestMerge(registry, "container merge", packedFiles, false, merged)
+        && OpenContainer(merged.data(), merged.size(), mergedContainer) && UnpackContainer(mergedContainer, unpacked) && unpacked == expected;
+    // everything between the end of the layout and the changed tail blocks is nobody's change
+    const size_t lastSame = (raws[0].size() - 3) / blockSize;
+    for (size_t b = sizeof(ExampleFileFormat) / blockSize + 1; b < lastSame && ok; b++)
+    {
+        ok = AreBlocksSame(mergedContainer, containers[0], b);
+    }
+    return SelfTestCheck("container merge", ok);
+}
+
+// every row of the table in merge_decision.h
+static bool SelfTestResolveModification(const FormatRegistry&, const std::filesystem::path&)
+{
+    struct Case
+    {
+        bool baseToLocal;
+        bool baseToRemote;
+        bool localToRemote;
+        MergeDecision decision;
+    };
+    const Case cases[] =
+    {
+        { true, true, true, MergeDecision::TAKE_BASE },
+        { true, true, false, MergeDecision::TAKE_BASE },
+        { true, false, true, MergeDecision::TAKE_LOCAL },
+        { false, true, true, MergeDecision::TAKE_LOCAL },
+        { true, false, false, MergeDecision::TAKE_REMOTE },
+        { false, true, false, MergeDecision::TAKE_LOCAL },
+        { false, false, true, MergeDecision::TAKE_LOCAL },
+        { false, false, false, MergeDecision::CONFLICT },
+    };
+    bool ok = true;
+    for (const Case& c : cases)
+    {
+        if (ResolveModification(c.baseToLocal, c.baseToRemote, c.localToRemote) != c.decision)
+        {
+            printf("selftest resolve modification: wrong decision for %d %d %d\n", c.baseToLocal, c.baseToRemote, c.localToRemote);
+            ok = false;
+        }
+    }
+    return SelfTestCheck("resolve modification", ok);
+}
+
+static bool (*const SelfTestChecks[])(const FormatRegistry& registry, const std::filesystem::path& scratch) =
+{
+    SelfTestRegistry,
+    SelfTestSchemaMismatch,
+    SelfTestFields,
+    SelfTestMergeFormats,
+    SelfTestMergeDriver,
+    SelfTestOutputWriter,
+    SelfTestSparseOutput,
+    SelfTestArray,
+    SelfTestVariable,
+    SelfTestNested,
+    SelfTestFlags,
+    SelfTestMigrate,
+    SelfTestMigrateVariable,
+    SelfTestConsole,
+    SelfTestMigrateEndianness,
+    SelfTestOctopus,
+    SelfTestOctopusKernels,
+    SelfTestContainers,
+    SelfTestResolveModification,
+};
+
+// returns the number of checks that failed. The checks that need real files get a scratch directory in the temp directory
+static int RunSelfTest(const FormatRegistry& registry)
+{
+    std::error_code error;
+    const std::filesystem::path scratch = std::filesystem::temp_directory_path(error) / "binmerge-selftest";
+    std::filesystem::remove_all(scratch, error);
+    if (!std::filesystem::create_directories(scratch, error))
+    {
+        printf("selftest: failed to create %s\n", scratch.string().c_str());
+        return 1;
+    }
+    int failed = 0;
+    for (auto check : SelfTestChecks)
+    {
+        failed += check(registry, scratch) ? 0 : 1;
+    }
+    std::filesystem::remove_all(scratch, error);
+    printf("selftest: %d failed\n", failed);
+    return failed;
+}
+// -----------------------------
+
+// terms:
+// base = original version of the file before changes
+// local = your changes (p4 calls this "target")
+// remote = someone else's changes (being merged against yours) (p4 calls this "source")
+int main(int argc, char* argv[])
+{
+    // merge driver modes
+    // git:      binmerge git %O %A %B        (the result is written over %A)
+    // perforce: binmerge p4 %b %1 %2 %r      (%1 is theirs, %2 is yours)
+    // anything:  binmerge merge <base> <local> <remote> <result>
+    // octopus:   binmerge octopus <base> <result> <revision> <revision> [<revision>...]
+    bool isGit = argc == 5 && strcmp(argv[1], "git") == 0;
+    bool isP4 = argc == 6 && strcmp(argv[1], "p4") == 0;
+    bool isMerge = argc == 6 && strcmp(argv[1], "merge") == 0;
+    bool isOctopus = argc >= 6 && strcmp(argv[1], "octopus") == 0;
+    if (isGit || isP4 || isMerge || isOctopus)
+    {
+        FormatRegistry registry = {};
+        if (!BuildFormatRegistry(registry, SchemaBundle, sizeof(SchemaBundle) / sizeof(SchemaBundle[0])))
+        {
+            return 2;
+        }
+        if (isGit)
+        {
+            return RunMergeDriver(registry, argv[2], argv[3], argv[4], argv[3]);
+        }
+        if (isP4)
+        {
+            return RunMergeDriver(registry, argv[2], argv[4], argv[3], argv[5]);
+        }
+        if (isOctopus)
+        {
+            return RunOctopusMerge(registry, argv[2], argv + 4, argc - 4, argv[3]);
+        }
+        return RunMergeDriver(registry, argv[2], argv[3], argv[4], argv[5]);
+    }
+
+    // block-compressed containers (container.h). The merge modes above handle these directly
+    // binmerge pack <file> <container> [blockSize]
+    // binmerge unpack <container> <file>
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "pack") == 0)
+    {
+        uint32_t blockSize = argc == 5 ? (uint32_t)strtoul(argv[4], nullptr, 0) : CONTAINER_DEFAULT_BLOCK_SIZE;
+        return RunPack(argv[2], argv[3], false, blockSize);
+    }
+    if (argc == 4 && strcmp(argv[1], "unpack") == 0)
+    {
+        return RunPack(argv[2], argv[3], true, 0);
+    }
+
+    // binmerge selftest
+    // merges small files of every bundled layout and checks the results, exit code is the number of failed checks
+    if (argc == 2 && strcmp(argv[1], "selftest") == 0)
+    {
+        FormatRegistry registry = {};
+        if (!BuildFormatRegistry(registry, SchemaBundle, sizeof(SchemaBundle) / sizeof(SchemaBundle[0])))
+        {
+            return 2;
+        }
+        return RunSelfTest(registry);
+    }
+
+    // binmerge migrate <directory> [--down]
+    // rewrites every ExampleFileFormat file under directory to ExampleFileFormatV2 (or back with --down)
+    if (argc >= 3 && strcmp(argv[1], "migrate") == 0)
+    {
+        bool down = argc >= 4 && strcmp(argv[3], "--down") == 0;
+        FinalizeLayout(&ExampleFileFormatHardcodedMetadata);
+        FinalizeLayout(&ExampleFileFormatV2HardcodedMetadata);
+        const FormatLayout& from = down ? ExampleFileFormatV2HardcodedMetadata : ExampleFileFormatHardcodedMetadata;
+        const FormatLayout& to = down ? ExampleFileFormatHardcodedMetadata : ExampleFileFormatV2HardcodedMetadata;
+        MigrationPlan plan = CompileMigration(from, to);
+        if (!plan.valid)
+        {
+            return 2;
+        }
+        MigrationStats stats = MigrateDirectory(plan, argv[2]);
+        printf("migrated %zu, skipped %zu, failed %zu\n", stats.migrated, stats.skipped, stats.failed);
+        return stats.failed ? 1 : 0;
+    }
+
+    ExampleFileFormat base =
+    {
+        .x = 10,
+        .pos = Vector3{ 1.0f, 2.0f, 3.0f },
+        .name = "test",
+        .counter = 123
+    };
+    ExampleFileFormat local =
+    {
+        .x = 10,
+        .pos = Vector3{ 1.0f, 2.0f, 3.0f },
+        .name = "testlocal",
+        .counter = 123
+    };
+    ExampleFileFormat remote =
+    {
+        .x = 10,
+        .pos = Vector3{ 1.0f, 2.0f, 3.0f },
+        .name = "testremote",
+        .counter = 123
+    };
+
+    FinalizeLayout(&ExampleFileFormatHardcodedMetadata);
+    ExampleFileFormat mergedData = {};
+    bool conflicts = false;
+    FormatLayout merged = {};
+    if (!MergeFormats(
+        ExampleFileFormatHardcodedMetadata, 
         ExampleFileFormatHardcodedMetadata,
         ExampleFileFormatHardcodedMetadata,
-        base, local, remote);
+        (const char*)&base, (const char*)&local, (const char*)&remote, (char*)&mergedData, merged, &conflicts))
+    {
+        return 2;
+    }
     printf("Resulting merged data:\n");
     PrintMe(&merged);
+    printf("data merge %s\n", conflicts ? "had conflicts" : "succeeded");
+    PrintMe(&mergedData);
     
     return 0;
 }
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "bitfield_merge.h"
+#include "file_index.h"
+#include "simd.h"
+
+
+BitfieldPlan CompileBitfieldPlan(const FormatLayout& layout)
+{
+    std::vector<BitfieldSpan> units = {};
+    BitfieldPlan plan = {};
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        const FieldData& field = layout.fields[i];
+        if (!IsFieldBitfield(&field) || IsFieldVariable(&field))
+        {
+            continue;
+        }
+        units.push_back({ field.offset, field.size });
+        if (field.bitWidth > 1)
+        {
+            plan.wideFields.push_back((uint32_t)i);
+        }
+    }
+    // flag words tend to sit next to each other, so this usually ends up being one span
+    std::sort(units.begin(), units.end(), [](const BitfieldSpan& a, const BitfieldSpan& b)
+    {
+        return a.offset < b.offset;
+    });
+    for (const BitfieldSpan& unit : units)
+    {
+        if (!plan.spans.empty() && unit.offset <= plan.spans.back().offset + plan.spans.back().size)
+        {
+            BitfieldSpan& prev = plan.spans.back();
+            prev.size = std::max(prev.offset + prev.size, unit.offset + unit.size) - prev.offset;
+            continue;
+        }
+        plan.spans.push_back(unit);
+    }
+    return plan;
+}
+
+bool MergeBits(const char* base, const char* local, const char* remote, char* merged, size_t size)
+{
+    size_t i = 0;
+    uint64_t anyLocal = 0;
+    uint64_t anyRemote = 0;
+#if BINMERGE_SSE2
+    __m128i localChanged = _mm_setzero_si128();
+    __m128i remoteChanged = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i*)(base + i));
+        __m128i l = _mm_loadu_si128((const __m128i*)(local + i));
+        __m128i r = _mm_loadu_si128((const __m128i*)(remote + i));
+        __m128i mL = _mm_xor_si128(b, l);
+        __m128i mR = _mm_xor_si128(b, r);
+        // andnot(a, b) is ~a & b
+        __m128i m = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(mL, mR), b), _mm_or_si128(_mm_and_si128(l, mL), _mm_and_si128(r, mR)));
+        _mm_storeu_si128((__m128i*)(merged + i), m);
+        localChanged = _mm_or_si128(localChanged, mL);
+        remoteChanged = _mm_or_si128(remoteChanged, mR);
+    }
+    const __m128i zero = _mm_setzero_si128();
+    anyLocal = _mm_movemask_epi8(_mm_cmpeq_epi8(localChanged, zero)) != 0xFFFF;
+    anyRemote = _mm_movemask_epi8(_mm_cmpeq_epi8(remoteChanged, zero)) != 0xFFFF;
+#endif
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t b, l, r;
+        memcpy(&b, base + i, 8);
+        memcpy(&l, local + i, 8);
+        memcpy(&r, remote + i, 8);
+        const uint64_t mL = b ^ l;
+        const uint64_t mR = b ^ r;
+        const uint64_t m = (b & ~(mL | mR)) | (l & mL) | (r & mR);
+        memcpy(merged + i, &m, 8);
+        anyLocal |= mL;
+        anyRemote |= mR;
+    }
+    for (; i < size; i++)
+    {
+        const uint8_t b = (uint8_t)base[i];
+        const uint8_t l = (uint8_t)local[i];
+        const uint8_t r = (uint8_t)remote[i];
+        const uint8_t mL = b ^ l;
+        const uint8_t mR = b ^ r;
+        merged[i] = (char)((b & ~(mL | mR)) | (l & mL) | (r & mR));
+        anyLocal |= mL;
+        anyRemote |= mR;
+    }
+    return anyLocal && anyRemote;
+}
+
+bool MergeBitfields(const FormatLayout& layout, const BitfieldPlan& plan, const char* base, const char* local, const char* remote, char* merged)
+{
+    bool bothChanged = false;
+    for (const BitfieldSpan& span : plan.spans)
+    {
+        const size_t offset = span.offset;
+        bothChanged = MergeBits(base + offset, local + offset, remote + offset, merged + offset, span.size) || bothChanged;
+    }
+    // the common case is done: single bit flags, or only one side touched the flags at all
+    if (!bothChanged || plan.wideFields.empty())
+    {
+        return true;
+    }
+
+    // a wide field is a number, and mixing the bits of two different numbers isn't a merge
+    bool result = true;
+    for (uint32_t fieldIndex : plan.wideFields)
+    {
+        const FieldData& field = layout.fields[fieldIndex];
+        const uint64_t mask = GetBitfieldMask(&field);
+        const uint64_t b = ReadUnsignedField(base + field.offset, field.size, layout.endianness);
+        const uint64_t l = ReadUnsignedField(local + field.offset, field.size, layout.endianness);
+        const uint64_t r = ReadUnsignedField(remote + field.offset, field.size, layout.endianness);
+        if (!((b ^ l) & mask) || !((b ^ r) & mask) || !((l ^ r) & mask))
+        {
+            continue;
+        }
+        printf("conflict in field %s: local %llu, remote %llu\n", field.name,
+            (unsigned long long)((l & mask) >> field.bitPosition), (unsigned long long)((r & mask) >> field.bitPosition));
+        const uint64_t m = ReadUnsignedField(merged + field.offset, field.size, layout.endianness);
+        WriteUnsignedField(merged + field.offset, field.size, (m & ~mask) | (l & mask), layout.endianness);
+        result = false;
+    }
+    return result;
+}
+
+size_t MergeBitsN(const char* base, const char* const* revisions, size_t revisionCount, size_t offset, char* merged, size_t size)
+{
+    // merged collects every revision's changes OR'd together, one revision at a time
+    // (each one is a single xor/or pass, and the span stays in cache for all of them).
+    // Flipping those bits in base at the end gives the result
+    const char* original = base + offset;
+    char* flipped = merged + offset;
+    memset(flipped, 0, size);
+    size_t changers = 0;
+    for (size_t r = 0; r < revisionCount; r++)
+    {
+        const char* revision = revisions[r] + offset;
+        size_t i = 0;
+        uint64_t any = 0;
+#if BINMERGE_SSE2
+        __m128i anyVector = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+        {
+            __m128i m = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(original + i)), _mm_loadu_si128((const __m128i*)(revision + i)));
+            _mm_storeu_si128((__m128i*)(flipped + i), _mm_or_si128(_mm_loadu_si128((const __m128i*)(flipped + i)), m));
+            anyVector = _mm_or_si128(anyVector, m);
+        }
+        any = _mm_movemask_epi8(_mm_cmpeq_epi8(anyVector, _mm_setzero_si128())) != 0xFFFF;
+#endif
+        for (; i < size; i++)
+        {
+            const uint8_t m = (uint8_t)(original[i] ^ revision[i]);
+            flipped[i] |= (char)m;
+            any |= m;
+        }
+        changers += any ? 1 : 0;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        flipped[i] ^= original[i];
+    }
+    return changers;
+}
+
+bool MergeBitfieldsN(const FormatLayout& layout, const BitfieldPlan& plan, const char* base, const char* const* revisions, size_t revisionCount, char* merged)
+{
+    bool severalChanged = false;
+    for (const BitfieldSpan& span : plan.spans)
+    {
+        severalChanged = MergeBitsN(base, revisions, revisionCount, span.offset, merged, span.size) > 1 || severalChanged;
+    }
+    if (!severalChanged || plan.wideFields.empty())
+    {
+        return true;
+    }
+
+    bool result = true;
+    for (uint32_t fieldIndex : plan.wideFields)
+    {
+        const FieldData& field = layout.fields[fieldIndex];
+        const uint64_t mask = GetBitfieldMask(&field);
+        const uint64_t b = ReadUnsignedField(base + field.offset, field.size, layout.endianness) & mask;
+        bool found = false;
+        uint64_t winner = 0;
+        for (size_t r = 0; r < revisionCount; r++)
+        {
+            const uint64_t value = ReadUnsignedField(revisions[r] + field.offset, field.size, layout.endianness) & mask;
+            if (value == b)
+            {
+                continue;
+            }
+            if (!found)
+            {
+                found = true;
+                winner = value;
+            }
+            else if (value != winner)
+            {
+                printf("conflict in field %s: revision %zu has %llu, an earlier one %llu\n", field.name, r,
+                    (unsigned long long)(value >> field.bitPosition), (unsigned long long)(winner >> field.bitPosition));
+                result = false;
+                break;
+            }
+        }
+        if (found)
+        {
+            const uint64_t m = ReadUnsignedField(merged + field.offset, field.size, layout.endianness);
+            WriteUnsignedField(merged + field.offset, field.size, (m & ~mask) | winner, layout.endianness);
+        }
+    }
+    return result;
+}
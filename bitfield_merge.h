@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "format_layout.h"
+
+
+// bitfields (engine flag words, mostly) are merged per bit instead of per field.
+// Treating the whole storage unit as one value means two people toggling different flags
+// in the same uint32_t conflict, even though their changes have nothing to do with each other.
+//
+// For every bit: mL = base ^ local, mR = base ^ remote, and
+//     merged = (base & ~(mL | mR)) | (local & mL) | (remote & mR)
+// A single bit can't conflict: if both sides changed it, they both flipped it to the same thing.
+// Only bitfields wider than one bit can, when both sides changed different bits of the same field.
+
+// storage units of bitfields, neighbouring ones joined
+struct BitfieldSpan
+{
+    size_t offset = 0;
+    size_t size = 0;
+};
+// where the bitfields of a layout live
+struct BitfieldPlan
+{
+    std::vector<BitfieldSpan> spans = {};
+    std::vector<uint32_t> wideFields = {}; // bitfields wider than 1 bit. These are the only ones that can conflict
+};
+BitfieldPlan CompileBitfieldPlan(const FormatLayout& layout);
+
+// the per-bit merge above over size bytes. Returns true if both local and remote changed something in the range
+bool MergeBits(const char* base, const char* local, const char* remote, char* merged, size_t size);
+
+// merges every bitfield of the layout. merged must already hold local's copy of the record.
+// Returns false if a wide bitfield was changed differently on both sides (merged keeps local's value for it)
+bool MergeBitfields(const FormatLayout& layout, const BitfieldPlan& plan, const char* base, const char* local, const char* remote, char* merged);
+
+// N-way versions. Bits still can't conflict: every revision that changed a bit flipped it the same way,
+// so merged = base ^ (changes of every revision OR'd together).
+// MergeBitsN returns how many revisions changed anything in the range
+size_t MergeBitsN(const char* base, const char* const* revisions, size_t revisionCount, size_t offset, char* merged, size_t size);
+bool MergeBitfieldsN(const FormatLayout& layout, const BitfieldPlan& plan, const char* base, const char* const* revisions, size_t revisionCount, char* merged);
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstring>
+
+#include "byteswap.h"
+#include "simd.h"
+
+
+#if BINMERGE_SSE2
+// sse2 has no byte shuffle, but swapping the bytes of every 16 bit lane is just two shifts,
+// and bigger values are that plus swapping the 16 bit lanes around
+static inline __m128i ByteSwapLanes16(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#endif
+
+void ByteSwap16(char* data, size_t count)
+{
+    size_t i = 0;
+#if BINMERGE_SSE2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i * 2));
+        _mm_storeu_si128((__m128i*)(data + i * 2), ByteSwapLanes16(v));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        std::swap(data[i * 2], data[i * 2 + 1]);
+    }
+}
+
+void ByteSwap32(char* data, size_t count)
+{
+    size_t i = 0;
+#if BINMERGE_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i * 4));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i*)(data + i * 4), ByteSwapLanes16(v));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        char* value = data + i * 4;
+        std::swap(value[0], value[3]);
+        std::swap(value[1], value[2]);
+    }
+}
+
+void ByteSwap64(char* data, size_t count)
+{
+    size_t i = 0;
+#if BINMERGE_SSE2
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i * 8));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128((__m128i*)(data + i * 8), ByteSwapLanes16(v));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        std::reverse(data + i * 8, data + i * 8 + 8);
+    }
+}
+
+void ByteSwapValues(char* data, size_t width, size_t count)
+{
+    switch (width)
+    {
+        case 2: ByteSwap16(data, count); break;
+        case 4: ByteSwap32(data, count); break;
+        case 8: ByteSwap64(data, count); break;
+        default: break;
+    }
+}
+
+bool IsSwappedType(Type type)
+{
+    switch (type)
+    {
+        case SHORT:
+        case INTEGER:
+        case LONG:
+        case FLOAT:
+        case DOUBLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool CanSwapField(const FieldData& field)
+{
+    if (const FormatLayout* child = GetChildLayout(&field))
+    {
+        for (size_t i = 0; i < child->fieldsCount; i++)
+        {
+            if (!IsFieldVariable(&child->fields[i]) && !CanSwapField(child->fields[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    return field.type != STRUCTURE && !(field.type == ARRAY && field.elementType == STRUCTURE);
+}
+
+static void AppendRun(size_t offset, size_t width, size_t count, std::vector<SwapRun>& runs)
+{
+    if (width != 2 && width != 4 && width != 8)
+    {
+        return;
+    }
+    if (!runs.empty())
+    {
+        SwapRun& prev = runs.back();
+        if (prev.width == width && prev.offset + prev.width * prev.count == offset)
+        {
+            prev.count += count;
+            return;
+        }
+    }
+    runs.push_back({ offset, width, count });
+}
+
+void AppendSwapRuns(const FieldData& field, size_t baseOffset, std::vector<SwapRun>& runs)
+{
+    const size_t offset = baseOffset + field.offset;
+    if (const FormatLayout* child = GetChildLayout(&field))
+    {
+        for (size_t i = 0; i < child->fieldsCount; i++)
+        {
+            if (!IsFieldVariable(&child->fields[i]))
+            {
+                AppendSwapRuns(child->fields[i], offset, runs);
+            }
+        }
+    }
+    else if (field.type == ARRAY)
+    {
+        if (IsSwappedType(field.elementType) && field.elementCount && field.size % field.elementCount == 0)
+        {
+            AppendRun(offset, field.size / field.elementCount, field.elementCount, runs);
+        }
+    }
+    else if (IsFieldBitfield(&field))
+    {
+        // every bitfield in a storage unit points at the same bytes, only swap them once
+        for (const SwapRun& run : runs)
+        {
+            if (run.offset <= offset && offset + field.size <= run.offset + run.width * run.count)
+            {
+                return;
+            }
+        }
+        AppendRun(offset, field.size, 1, runs);
+    }
+    else if (IsSwappedType(field.type))
+    {
+        // the width comes from the field, not the type, so an 8 byte INTEGER is still swapped as one value
+        AppendRun(offset, field.size, 1, runs);
+    }
+}
+
+std::vector<SwapRun> CompileSwapRuns(const FieldData* const* fields, size_t fieldCount)
+{
+    std::vector<const FieldData*> sorted(fields, fields + fieldCount);
+    // in offset order, so neighbours of the same width become one run
+    std::sort(sorted.begin(), sorted.end(), [](const FieldData* a, const FieldData* b)
+    {
+        return a->offset < b->offset;
+    });
+    std::vector<SwapRun> runs = {};
+    for (const FieldData* field : sorted)
+    {
+        AppendSwapRuns(*field, 0, runs);
+    }
+    return runs;
+}
+
+void ApplySwapRuns(const SwapRun* runs, size_t runCount, char* data)
+{
+    for (size_t i = 0; i < runCount; i++)
+    {
+        ByteSwapValues(data + runs[i].offset, runs[i].width, runs[i].count);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "format_layout.h"
+
+
+// files written on a machine of the other endianness (big endian console assets, mostly).
+// Numbers in them have to be swapped before we can look at them as numbers, and swapped back
+// when writing. Everything here works in place on whole runs of values: arrays, and neighbouring
+// fields of the same width, go through the vector kernels in one call instead of one field at a time.
+
+// reverses the bytes of count values of 2, 4 or 8 bytes each
+void ByteSwap16(char* data, size_t count);
+void ByteSwap32(char* data, size_t count);
+void ByteSwap64(char* data, size_t count);
+// picks one of the above. Width 1 (or anything else) is left alone
+void ByteSwapValues(char* data, size_t width, size_t count);
+
+// numbers are the only thing that get swapped. Strings, raw buffers and opaque structures are byte streams
+bool IsSwappedType(Type type);
+
+// false if field holds values whose byte order we have no way of knowing: a STRUCTURE without a nested layout
+// (an opaque one, or an array of them), anywhere inside field. AppendSwapRuns would leave those bytes as they are
+bool CanSwapField(const FieldData& field);
+
+// count values of width bytes each, starting at offset
+struct SwapRun
+{
+    size_t offset = 0;
+    size_t width = 0;
+    size_t count = 0;
+};
+// adds the values that make up field to runs, with field's offset moved by baseOffset (for nested layouts).
+// Joins the last run when it lines up, so fields appended in offset order turn into as few runs as possible
+void AppendSwapRuns(const FieldData& field, size_t baseOffset, std::vector<SwapRun>& runs);
+// the swaps for a set of fixed fields, in any order. They get sorted by offset first,
+// so neighbours of the same width end up in one run no matter where they sit in the layout
+std::vector<SwapRun> CompileSwapRuns(const FieldData* const* fields, size_t fieldCount);
+void ApplySwapRuns(const SwapRun* runs, size_t runCount, char* data);
@@ -0,0 +1,146 @@
+#include <assert.h>
+#include <cmath>
+#include <cstring>
+
+#include "byteswap.h"
+#include "compare_kernels.h"
+#include "simd.h"
+
+
+bool CompareBytes(const char* first, const char* second, size_t size)
+{
+    // memcmp is already vectorized by every CRT we care about, this covers the integer types
+    return memcmp(first, second, size) == 0;
+}
+
+bool CompareCString(const char* first, const char* second, size_t size)
+{
+    // strnlen bounds us to the field, so a string that fills the whole buffer (no NUL) still works
+    size_t firstLen = strnlen(first, size);
+    size_t secondLen = strnlen(second, size);
+    return firstLen == secondLen && memcmp(first, second, firstLen) == 0;
+}
+
+bool CompareFloats(const char* first, const char* second, size_t size)
+{
+    const size_t count = size / sizeof(float);
+    size_t i = 0;
+#if BINMERGE_SSE2
+    // 4 floats at a time. cmpeq already says -0.0 == 0.0, and cmpunord(x, x) is "x is NaN",
+    // so two lanes are equivalent if they're equal or both NaN
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 a = _mm_loadu_ps((const float*)first + i);
+        __m128 b = _mm_loadu_ps((const float*)second + i);
+        __m128 bothNan = _mm_and_ps(_mm_cmpunord_ps(a, a), _mm_cmpunord_ps(b, b));
+        __m128 same = _mm_or_ps(_mm_cmpeq_ps(a, b), bothNan);
+        if (_mm_movemask_ps(same) != 0xF)
+        {
+            return false;
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float a, b;
+        memcpy(&a, first + i * sizeof(float), sizeof(float));
+        memcpy(&b, second + i * sizeof(float), sizeof(float));
+        if (!(a == b || (std::isnan(a) && std::isnan(b))))
+        {
+            return false;
+        }
+    }
+    const size_t tail = count * sizeof(float);
+    return CompareBytes(first + tail, second + tail, size - tail);
+}
+
+bool CompareDoubles(const char* first, const char* second, size_t size)
+{
+    const size_t count = size / sizeof(double);
+    size_t i = 0;
+#if BINMERGE_SSE2
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128d a = _mm_loadu_pd((const double*)first + i);
+        __m128d b = _mm_loadu_pd((const double*)second + i);
+        __m128d bothNan = _mm_and_pd(_mm_cmpunord_pd(a, a), _mm_cmpunord_pd(b, b));
+        __m128d same = _mm_or_pd(_mm_cmpeq_pd(a, b), bothNan);
+        if (_mm_movemask_pd(same) != 0x3)
+        {
+            return false;
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        double a, b;
+        memcpy(&a, first + i * sizeof(double), sizeof(double));
+        memcpy(&b, second + i * sizeof(double), sizeof(double));
+        if (!(a == b || (std::isnan(a) && std::isnan(b))))
+        {
+            return false;
+        }
+    }
+    const size_t tail = count * sizeof(double);
+    return CompareBytes(first + tail, second + tail, size - tail);
+}
+
+// swaps a block of each side into scratch buffers and hands them to the native kernel,
+// so big float arrays get swapped and compared with vectors without allocating anything
+template <size_t Width, bool (*Compare)(const char*, const char*, size_t)>
+static bool CompareSwapped(const char* first, const char* second, size_t size)
+{
+    const size_t whole = size - size % Width;
+    char a[1024];
+    char b[1024];
+    for (size_t offset = 0; offset < whole; offset += sizeof(a))
+    {
+        const size_t chunk = whole - offset < sizeof(a) ? whole - offset : sizeof(a);
+        memcpy(a, first + offset, chunk);
+        memcpy(b, second + offset, chunk);
+        ByteSwapValues(a, Width, chunk / Width);
+        ByteSwapValues(b, Width, chunk / Width);
+        if (!Compare(a, b, chunk))
+        {
+            return false;
+        }
+    }
+    return CompareBytes(first + whole, second + whole, size - whole);
+}
+
+bool CompareFloatsSwapped(const char* first, const char* second, size_t size)
+{
+    return CompareSwapped<sizeof(float), CompareFloats>(first, second, size);
+}
+
+bool CompareDoublesSwapped(const char* first, const char* second, size_t size)
+{
+    return CompareSwapped<sizeof(double), CompareDoubles>(first, second, size);
+}
+
+FieldCompareFn SelectCompareKernel(Type type, Endianness endianness)
+{
+    const bool swapped = endianness != Endianness::LITTLE;
+    switch (type)
+    {
+        case FLOAT: return swapped ? CompareFloatsSwapped : CompareFloats;
+        case DOUBLE: return swapped ? CompareDoublesSwapped : CompareDoubles;
+        case CSTRING: return CompareCString;
+        // integers, raw buffers, and structures without a nested layout are just bytes
+        default: return CompareBytes;
+    }
+}
+
+std::vector<FieldCompareFn> SelectCompareKernels(const FormatLayout& layout)
+{
+    assert(IsLayoutFinalized(&layout));
+    const LayoutColumns& columns = layout.columns;
+    std::vector<FieldCompareFn> kernels(columns.types.size());
+    for (size_t i = 0; i < kernels.size(); i++)
+    {
+        // a whole array compares the same way its elements do.
+        // Nested layouts are stored in the file's byte order too, so they all go by the outer layout's endianness
+        kernels[i] = SelectCompareKernel(columns.types[i] == ARRAY ? columns.fields[i]->elementType : columns.types[i], layout.endianness);
+    }
+    return kernels;
+}
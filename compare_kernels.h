@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "format_layout.h"
+
+
+// "are these two copies of a field the same value?"
+// raw byte equality is the wrong answer for a bunch of types. A CSTRING can have arbitrary garbage
+// after its NUL terminator, and floats have -0.0 == 0.0 and many different NaN bit patterns.
+// Saying those differ turns into false merge conflicts, so each Type gets its own comparison.
+// Every kernel compares "size" bytes at first and second, and returns true if they're equivalent.
+typedef bool (*FieldCompareFn)(const char* first, const char* second, size_t size);
+
+bool CompareBytes(const char* first, const char* second, size_t size);
+// only compares up to (and including) the first NUL, bounded by size
+bool CompareCString(const char* first, const char* second, size_t size);
+// size can cover a whole array of floats/doubles. Any trailing bytes that don't make up a full element are compared raw
+bool CompareFloats(const char* first, const char* second, size_t size);
+bool CompareDoubles(const char* first, const char* second, size_t size);
+
+// the same for floats stored in the other byte order. Integers don't need these: two integers are equal
+// exactly when their bytes are, whichever order they're in. Floats have -0.0 and NaNs, so they have to be swapped first
+bool CompareFloatsSwapped(const char* first, const char* second, size_t size);
+bool CompareDoublesSwapped(const char* first, const char* second, size_t size);
+
+FieldCompareFn SelectCompareKernel(Type type, Endianness endianness = Endianness::LITTLE);
+// picks the kernel for every row of the layout's columns up front, so merge loops don't switch on the type per field.
+// The layout has to be finalized. Row i is fields[i] for i < fieldsCount, the rest are the nested layouts' fields
+std::vector<FieldCompareFn> SelectCompareKernels(const FormatLayout& layout);
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "container.h"
+#include "lz.h"
+#include "parallel.h"
+
+
+bool IsContainer(const char* data, size_t len)
+{
+    uint32_t magic = 0;
+    if (len < sizeof(ContainerHeader))
+    {
+        return false;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    return magic == CONTAINER_MAGIC;
+}
+
+bool OpenContainer(const char* data, size_t len, Container& container)
+{
+    if (!IsContainer(data, len))
+    {
+        printf("not a container\n");
+        return false;
+    }
+    container.data = data;
+    container.len = len;
+    memcpy(&container.header, data, sizeof(container.header));
+    const ContainerHeader& header = container.header;
+    const uint64_t expectedBlocks = header.blockSize ? (header.rawSize + header.blockSize - 1) / header.blockSize : 0;
+    if (header.blockSize == 0 || header.blockCount != expectedBlocks ||
+        header.tableOffset > len || (len - header.tableOffset) / sizeof(ContainerBlock) < header.blockCount)
+    {
+        printf("container header is broken\n");
+        return false;
+    }
+    // the table isn't necessarily aligned, copy it out
+    container.blocks.resize(header.blockCount);
+    memcpy(container.blocks.data(), data + header.tableOffset, header.blockCount * sizeof(ContainerBlock));
+    for (size_t i = 0; i < container.blocks.size(); i++)
+    {
+        const ContainerBlock& block = container.blocks[i];
+        if (block.offset < sizeof(ContainerHeader) || block.offset > len || block.size > len - block.offset ||
+            ((block.flags & CONTAINER_BLOCK_STORED) && block.size != GetBlockRawSize(container, i)))
+        {
+            printf("container block %zu is broken\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t GetBlockRawSize(const Container& container, size_t block)
+{
+    const uint64_t start = (uint64_t)block * container.header.blockSize;
+    return (size_t)std::min<uint64_t>(container.header.blockSize, container.header.rawSize - start);
+}
+
+bool AreBlocksSame(const Container& first, const Container& second, size_t block)
+{
+    if (block >= first.blocks.size() || block >= second.blocks.size())
+    {
+        return false;
+    }
+    const ContainerBlock& a = first.blocks[block];
+    const ContainerBlock& b = second.blocks[block];
+    if (a.size != b.size || a.flags != b.flags || GetBlockRawSize(first, block) != GetBlockRawSize(second, block))
+    {
+        return false;
+    }
+    return memcmp(first.data + a.offset, second.data + b.offset, a.size) == 0;
+}
+
+static bool DecompressBlock(const Container& container, size_t block, char* dst)
+{
+    const ContainerBlock& entry = container.blocks[block];
+    const size_t rawSize = GetBlockRawSize(container, block);
+    if (entry.flags & CONTAINER_BLOCK_STORED)
+    {
+        memcpy(dst, container.data + entry.offset, rawSize);
+        return true;
+    }
+    return LzDecompress(container.data + entry.offset, entry.size, dst, rawSize);
+}
+
+bool DecompressBlocks(const BlockJob* jobs, size_t jobCount, uint32_t threadCount)
+{
+    std::atomic<bool> failed = false;
+    ParallelFor(jobCount, threadCount, [&](size_t i)
+    {
+        if (!DecompressBlock(*jobs[i].container, jobs[i].block, jobs[i].dst))
+        {
+            printf("container block %zu doesn't decompress\n", jobs[i].block);
+            failed = true;
+        }
+    });
+    return !failed;
+}
+
+bool UnpackContainer(const Container& container, std::vector<char>& raw, uint32_t threadCount)
+{
+    raw.resize((size_t)container.header.rawSize);
+    std::vector<BlockJob> jobs(container.blocks.size());
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        jobs[i] = { &container, i, raw.data() + i * container.header.blockSize };
+    }
+    return DecompressBlocks(jobs.data(), jobs.size(), threadCount);
+}
+
+bool WriteContainer(const Container* update, uint32_t blockSize, uint64_t rawSize, const std::vector<OutputBlock>& blocks, std::vector<char>& out, uint32_t threadCount)
+{
+    if (blockSize == 0 || blocks.size() != (rawSize + blockSize - 1) / blockSize)
+    {
+        printf("blocks don't add up to the container size\n");
+        return false;
+    }
+    // compress everything new first, in parallel. Blocks that don't get any smaller are stored as is
+    std::vector<std::vector<char>> compressed(blocks.size());
+    ParallelFor(blocks.size(), threadCount, [&](size_t i)
+    {
+        const OutputBlock& block = blocks[i];
+        if (block.source)
+        {
+            return;
+        }
+        std::vector<char>& dst = compressed[i];
+        dst.resize(LzCompressBound(block.rawSize));
+        size_t size = LzCompress(block.raw, block.rawSize, dst.data());
+        if (size >= block.rawSize)
+        {
+            dst.assign(block.raw, block.raw + block.rawSize);
+        }
+        else
+        {
+            dst.resize(size);
+        }
+    });
+
+    // reusing update's bytes only pays off while most of them are still referenced
+    size_t reusedBytes = 0;
+    size_t newBytes = 0;
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        const OutputBlock& block = blocks[i];
+        if (update && block.source == update)
+        {
+            reusedBytes += update->blocks[block.sourceBlock].size;
+        }
+        else
+        {
+            newBytes += block.source ? block.source->blocks[block.sourceBlock].size : compressed[i].size();
+        }
+    }
+    const size_t freshSize = sizeof(ContainerHeader) + reusedBytes + newBytes;
+    const bool inPlace = update && update->header.tableOffset + newBytes <= freshSize + freshSize / 4;
+
+    ContainerHeader header = {};
+    header.blockSize = blockSize;
+    header.rawSize = rawSize;
+    header.blockCount = (uint32_t)blocks.size();
+    std::vector<ContainerBlock> table(blocks.size());
+    out.clear();
+    if (inPlace)
+    {
+        out.insert(out.end(), update->data, update->data + update->header.tableOffset);
+    }
+    else
+    {
+        out.resize(sizeof(ContainerHeader));
+    }
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        const OutputBlock& block = blocks[i];
+        if (inPlace && block.source == update)
+        {
+            table[i] = update->blocks[block.sourceBlock];
+            continue;
+        }
+        const char* data = nullptr;
+        if (block.source)
+        {
+            table[i] = block.source->blocks[block.sourceBlock];
+            data = block.source->data + table[i].offset;
+        }
+        else
+        {
+            table[i].size = (uint32_t)compressed[i].size();
+            table[i].flags = compressed[i].size() == block.rawSize ? CONTAINER_BLOCK_STORED : 0;
+            data = compressed[i].data();
+        }
+        table[i].offset = out.size();
+        out.insert(out.end(), data, data + table[i].size);
+    }
+    header.tableOffset = out.size();
+    const char* tableBytes = (const char*)table.data();
+    out.insert(out.end(), tableBytes, tableBytes + table.size() * sizeof(ContainerBlock));
+    memcpy(out.data(), &header, sizeof(header));
+    return true;
+}
+
+bool PackContainer(const char* raw, size_t rawSize, uint32_t blockSize, std::vector<char>& out, uint32_t threadCount)
+{
+    if (blockSize == 0)
+    {
+        return false;
+    }
+    std::vector<OutputBlock> blocks((rawSize + blockSize - 1) / blockSize);
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        blocks[i].raw = raw + i * blockSize;
+        blocks[i].rawSize = std::min<size_t>(blockSize, rawSize - i * blockSize);
+    }
+    return WriteContainer(nullptr, blockSize, rawSize, blocks, out, threadCount);
+}
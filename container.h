@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// block-compressed wrapper around a file, the way most shipped assets are stored.
+// The raw file is cut into blockSize blocks that are compressed on their own (lz.h), so a merge can
+// decompress just the blocks it needs, and write back just the blocks that changed.
+//   ContainerHeader
+//   compressed blocks, in any order. Updating a container appends replacement blocks, so there can be dead ones too
+//   ContainerBlock table with blockCount entries, at tableOffset
+// Everything is little endian.
+constexpr uint32_t CONTAINER_MAGIC = 0x315A4D42; // "BMZ1"
+constexpr uint32_t CONTAINER_DEFAULT_BLOCK_SIZE = 64 * 1024;
+constexpr uint32_t CONTAINER_BLOCK_STORED = 1; // the block didn't compress, it's stored as is
+
+struct ContainerHeader
+{
+    uint32_t magic = CONTAINER_MAGIC;
+    uint32_t blockSize = 0;
+    uint64_t rawSize = 0;
+    uint64_t tableOffset = 0;
+    uint32_t blockCount = 0;
+    uint32_t reserved = 0;
+};
+struct ContainerBlock
+{
+    uint64_t offset = 0;
+    uint32_t size = 0; // compressed
+    uint32_t flags = 0;
+};
+
+// an opened container. data is the whole container file, and has to outlive this
+struct Container
+{
+    const char* data = nullptr;
+    size_t len = 0;
+    ContainerHeader header = {};
+    std::vector<ContainerBlock> blocks = {};
+};
+
+bool IsContainer(const char* data, size_t len);
+// reads the header and block table. Fails (and prints why) if they don't hold together
+bool OpenContainer(const char* data, size_t len, Container& container);
+// raw bytes in block i (only the last block can be short)
+size_t GetBlockRawSize(const Container& container, size_t block);
+// same compressed bytes. Compression is deterministic, so for blocks written by us that means the same raw bytes
+bool AreBlocksSame(const Container& first, const Container& second, size_t block);
+
+// one block to decompress, into dst (GetBlockRawSize bytes)
+struct BlockJob
+{
+    const Container* container = nullptr;
+    size_t block = 0;
+    char* dst = nullptr;
+};
+// blocks are independent, so they're spread over threadCount threads (0 = every hardware thread)
+bool DecompressBlocks(const BlockJob* jobs, size_t jobCount, uint32_t threadCount = 0);
+bool UnpackContainer(const Container& container, std::vector<char>& raw, uint32_t threadCount = 0);
+
+// what goes into block i of a container being written: either an existing compressed block copied
+// over verbatim, or raw bytes that still need compressing
+struct OutputBlock
+{
+    const Container* source = nullptr;
+    size_t sourceBlock = 0;
+    const char* raw = nullptr;
+    size_t rawSize = 0;
+};
+// builds a container out of blocks into out, compressing the raw ones in parallel.
+// If update is set, out starts as a copy of it: blocks taken from update stay where they are, and
+// everything else is appended after them, so out only differs from update at the end of the file (and the header).
+// When that would leave too much dead space behind, the container is written out fresh instead
+bool WriteContainer(const Container* update, uint32_t blockSize, uint64_t rawSize, const std::vector<OutputBlock>& blocks, std::vector<char>& out, uint32_t threadCount = 0);
+bool PackContainer(const char* raw, size_t rawSize, uint32_t blockSize, std::vector<char>& out, uint32_t threadCount = 0);
@@ -0,0 +1,152 @@
+#include <cstdio>
+#include <cstring>
+
+#include "array_merge.h"
+#include "file_index.h"
+
+
+uint64_t ReadUnsignedField(const char* data, size_t size, Endianness endianness)
+{
+    uint64_t result = 0;
+    size = size < sizeof(result) ? size : sizeof(result);
+    for (size_t i = 0; i < size; i++)
+    {
+        const size_t byte = endianness == Endianness::BIG ? size - 1 - i : i;
+        result |= (uint64_t)(uint8_t)data[byte] << (i * 8);
+    }
+    return result;
+}
+void WriteUnsignedField(char* data, size_t size, uint64_t value, Endianness endianness)
+{
+    size = size < sizeof(value) ? size : sizeof(value);
+    for (size_t i = 0; i < size; i++)
+    {
+        const size_t byte = endianness == Endianness::BIG ? size - 1 - i : i;
+        data[byte] = (char)(value >> (i * 8));
+    }
+}
+
+bool BuildFileIndex(const FormatLayout& layout, const char* data, size_t len, FileIndex& index)
+{
+    const size_t fixedExtent = GetLayoutExtent(&layout);
+    if (len < fixedExtent)
+    {
+        printf("file is %zu bytes, but the fixed part of the layout alone is %zu\n", len, fixedExtent);
+        return false;
+    }
+    index.fields.assign(layout.fieldsCount, {});
+
+    // fixed fields first, since the variable ones need their counts
+    const LayoutColumns& columns = layout.columns;
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        if (!(columns.flags[i] & FIELD_FLAG_VARIABLE))
+        {
+            index.fields[i] = { columns.offsets[i], columns.sizes[i], 1 };
+        }
+    }
+    // then the variable fields, which are packed back to back after the fixed part
+    size_t cursor = fixedExtent;
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        const FieldData& field = layout.fields[i];
+        if (!IsFieldVariable(&field))
+        {
+            continue;
+        }
+        if (field.countField >= layout.fieldsCount)
+        {
+            printf("field %s is sized by field %u, which doesn't exist\n", field.name, field.countField);
+            return false;
+        }
+        const FieldData& countField = layout.fields[field.countField];
+        if (IsFieldVariable(&countField))
+        {
+            printf("field %s is sized by %s, which isn't a fixed field\n", field.name, countField.name);
+            return false;
+        }
+        const uint64_t count = ReadUnsignedField(data + countField.offset, countField.size, layout.endianness);
+        // divide instead of multiply so a garbage count can't overflow past the check
+        if (field.size && count > (len - cursor) / field.size)
+        {
+            printf("field %s has %llu elements, which runs off the end of the file\n", field.name, (unsigned long long)count);
+            return false;
+        }
+        index.fields[i] = { cursor, (size_t)count * field.size, (size_t)count };
+        cursor += (size_t)count * field.size;
+    }
+    index.end = cursor;
+
+    // now everything has a place, make sure the offsets point somewhere real
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        const FieldData& field = layout.fields[i];
+        if (field.targetField == INVALID_FIELD_INDEX)
+        {
+            continue;
+        }
+        if (field.targetField >= layout.fieldsCount)
+        {
+            printf("field %s points into field %u, which doesn't exist\n", field.name, field.targetField);
+            return false;
+        }
+        const uint64_t target = ReadUnsignedField(data + index.fields[i].offset, field.size, layout.endianness);
+        if (target >= index.fields[field.targetField].size && target != 0)
+        {
+            printf("field %s points %llu bytes into %s, which is only %zu bytes\n",
+                field.name, (unsigned long long)target, layout.fields[field.targetField].name, index.fields[field.targetField].size);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CheckOffsetFields(
+    const FormatLayout& layout, const FieldCompareFn* kernels,
+    const char* base, const FileIndex& baseIndex,
+    const char* const* revisions, const FileIndex* const* indices, size_t revisionCount)
+{
+    bool result = true;
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        const FieldData& field = layout.fields[i];
+        if (field.targetField == INVALID_FIELD_INDEX)
+        {
+            continue;
+        }
+        const uint32_t t = field.targetField;
+        auto offsetIn = [&](const char* data, const FileIndex& index)
+        {
+            return ReadUnsignedField(data + index.fields[i].offset, field.size, layout.endianness);
+        };
+        const uint64_t baseOffset = offsetIn(base, baseIndex);
+        const IndexedField& baseTarget = baseIndex.fields[t];
+        bool conflict = false;
+        for (size_t a = 0; a < revisionCount && !conflict; a++)
+        {
+            const uint64_t moved = offsetIn(revisions[a], *indices[a]);
+            if (moved == baseOffset)
+            {
+                continue;
+            }
+            // revision a moved the offset. Any other revision that didn't move it the same way
+            // must not have touched what it points into
+            for (size_t b = 0; b < revisionCount && !conflict; b++)
+            {
+                if (b == a || offsetIn(revisions[b], *indices[b]) == moved)
+                {
+                    continue;
+                }
+                const IndexedField& target = indices[b]->fields[t];
+                conflict = !AreElementsSame(kernels[t], layout.fields[t].size,
+                    base + baseTarget.offset, baseTarget.count, revisions[b] + target.offset, target.count);
+            }
+        }
+        if (conflict)
+        {
+            printf("conflict in field %s: it was moved on one side while %s was changed on another\n", field.name, layout.fields[t].name);
+            result = false;
+        }
+    }
+    return result;
+}
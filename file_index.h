@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "compare_kernels.h"
+#include "format_layout.h"
+
+
+// where every field of a layout actually lives in one particular file.
+// Fixed fields just sit at their offset, but variable length fields depend on the counts
+// stored in that file, so we walk the file once up front and write down where everything is.
+// After that, any field (or the thing an offset field points at) is a direct lookup.
+struct IndexedField
+{
+    size_t offset = 0;
+    size_t size = 0; // total size in this file. For variable fields, that's count * element size
+    size_t count = 1; // number of elements. Always 1 for fixed fields
+};
+struct FileIndex
+{
+    std::vector<IndexedField> fields = {}; // 1:1 with the layout's fields
+    size_t end = 0; // one past the last byte described by the layout
+};
+
+// unsigned integer of 1, 2, 4 or 8 bytes, in the file's byte order. Used for count and offset fields
+uint64_t ReadUnsignedField(const char* data, size_t size, Endianness endianness = Endianness::LITTLE);
+void WriteUnsignedField(char* data, size_t size, uint64_t value, Endianness endianness = Endianness::LITTLE);
+
+// one linear pass over the file. Fails (and prints why) if a count runs off the end of the file,
+// or an offset field points outside of its target field (0 into an empty target is fine, there's nothing else to point at)
+bool BuildFileIndex(const FormatLayout& layout, const char* data, size_t len, FileIndex& index);
+
+// an offset field and the field it points into are merged separately, so they can come from different revisions:
+// one revision moves the offset while another rewrites or resizes the target, and the merged offset points at
+// something else (or past the end). Neither field conflicts on its own, so this is checked once everything is merged.
+// indices[r] is the index of revisions[r]. Prints and returns false if any offset field has that problem
+bool CheckOffsetFields(
+    const FormatLayout& layout, const FieldCompareFn* kernels,
+    const char* base, const FileIndex& baseIndex,
+    const char* const* revisions, const FileIndex* const* indices, size_t revisionCount);
@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <assert.h>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "byteswap.h"
+#include "file_index.h"
+#include "format_layout.h"
+#include "simd.h"
+
+
+bool AreFieldsSame(const FieldData* first, const FieldData* second)
+{
+    return first->size == second->size && first->bitWidth == second->bitWidth && strncmp(first->name, second->name, MAX_IDENTIFIER_LENGTH) == 0;
+}
+bool IsFieldEmpty(const FieldData* field)
+{
+    return field->size == 0;
+}
+bool IsFieldVariable(const FieldData* field)
+{
+    return field->countField != INVALID_FIELD_INDEX;
+}
+bool IsFieldBitfield(const FieldData* field)
+{
+    return field->bitWidth != 0;
+}
+uint64_t MakeBitMask(uint8_t position, uint8_t width)
+{
+    const uint64_t bits = width >= 64 ? ~0ull : (1ull << width) - 1;
+    return position >= 64 ? 0 : bits << position;
+}
+uint64_t GetBitfieldMask(const FieldData* field)
+{
+    return MakeBitMask(field->bitPosition, field->bitWidth);
+}
+const FormatLayout* GetChildLayout(const FieldData* field)
+{
+    return field->type == STRUCTURE ? reinterpret_cast<const FormatLayout*>(field->data) : nullptr;
+}
+
+size_t GetStructureSize(FormatLayout* layout)
+{
+    assert(IsLayoutFinalized(layout));
+    const LayoutColumns& columns = layout->columns;
+    size_t result = 0;
+    for (size_t i = 0; i < layout->fieldsCount; i++)
+    {
+        // branch free, so this is a straight vectorizable sum
+        result += columns.sizes[i] & (0 - (size_t)!(columns.flags[i] & FIELD_FLAG_VARIABLE));
+    }
+    return result;
+}
+size_t GetLayoutExtent(const FormatLayout* layout)
+{
+    assert(IsLayoutFinalized(layout));
+    const LayoutColumns& columns = layout->columns;
+    size_t result = sizeof(layout->magic);
+    for (size_t i = 0; i < layout->fieldsCount; i++)
+    {
+        const size_t fieldEnd = (columns.offsets[i] + columns.sizes[i]) & (0 - (size_t)!(columns.flags[i] & FIELD_FLAG_VARIABLE));
+        result = fieldEnd > result ? fieldEnd : result;
+    }
+    return result;
+}
+static uint64_t Fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+template <typename T>
+static uint64_t Fnv1a(uint64_t hash, const T& value)
+{
+    return Fnv1a(hash, &value, sizeof(value));
+}
+uint64_t ComputeLayoutFingerprint(const FormatLayout* layout)
+{
+    // each value is hashed at a fixed width (and names with their terminator) so
+    // different layouts can't line up into the same byte stream
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = Fnv1a(hash, (uint64_t)layout->fieldsCount);
+    for (size_t i = 0; i < layout->fieldsCount; i++)
+    {
+        const FieldData& field = layout->fields[i];
+        hash = Fnv1a(hash, field.name, strnlen(field.name, MAX_IDENTIFIER_LENGTH) + 1);
+        hash = Fnv1a(hash, (uint64_t)field.size);
+        hash = Fnv1a(hash, (uint64_t)field.offset);
+        hash = Fnv1a(hash, (int32_t)field.type);
+        hash = Fnv1a(hash, (int32_t)field.elementType);
+        hash = Fnv1a(hash, field.elementCount);
+        hash = Fnv1a(hash, field.countField);
+        hash = Fnv1a(hash, field.targetField);
+        hash = Fnv1a(hash, field.bitPosition);
+        hash = Fnv1a(hash, field.bitWidth);
+        const FormatLayout* child = GetChildLayout(&field);
+        hash = Fnv1a(hash, child ? ComputeLayoutFingerprint(child) : 0ull);
+    }
+    // same fields in the other byte order are not the same bytes
+    hash = Fnv1a(hash, (uint8_t)layout->endianness);
+    // 0 is reserved for "not computed"
+    return hash ? hash : 1;
+}
+namespace
+{
+    std::mutex g_fieldNamesMutex;
+    std::unordered_map<std::string, uint32_t> g_fieldNames;
+}
+uint32_t InternFieldName(const char* name)
+{
+    std::lock_guard<std::mutex> lock(g_fieldNamesMutex);
+    auto it = g_fieldNames.emplace(std::string(name, strnlen(name, MAX_IDENTIFIER_LENGTH)), (uint32_t)g_fieldNames.size()).first;
+    return it->second;
+}
+bool GetMergeableChildRows(const LayoutColumns& columns, size_t row, size_t* firstRowOut, size_t* rowCountOut)
+{
+    const size_t first = columns.childRows[row];
+    const size_t count = columns.childCounts[row];
+    if (first == INVALID_FIELD_INDEX || count == 0)
+    {
+        return false;
+    }
+    for (size_t i = first; i < first + count; i++)
+    {
+        if (columns.flags[i] & (FIELD_FLAG_VARIABLE | FIELD_FLAG_BITFIELD))
+        {
+            return false;
+        }
+    }
+    *firstRowOut = first;
+    *rowCountOut = count;
+    return true;
+}
+// adds a run of rows for layout's fields, then the runs of their nested layouts
+static void AppendColumns(LayoutColumns& columns, const FormatLayout* layout, size_t baseOffset)
+{
+    const uint32_t firstRow = (uint32_t)columns.offsets.size();
+    for (size_t i = 0; i < layout->fieldsCount; i++)
+    {
+        const FieldData& field = layout->fields[i];
+        columns.offsets.push_back(baseOffset + field.offset);
+        columns.sizes.push_back(field.size);
+        columns.types.push_back(field.type);
+        columns.flags.push_back((IsFieldVariable(&field) ? FIELD_FLAG_VARIABLE : 0) | (IsFieldBitfield(&field) ? FIELD_FLAG_BITFIELD : 0));
+        columns.bitWidths.push_back(field.bitWidth);
+        columns.nameIds.push_back(InternFieldName(field.name));
+        columns.childRows.push_back(INVALID_FIELD_INDEX);
+        columns.childCounts.push_back(0);
+        columns.fields.push_back(&field);
+    }
+    for (size_t i = 0; i < layout->fieldsCount; i++)
+    {
+        const FieldData& field = layout->fields[i];
+        if (const FormatLayout* child = GetChildLayout(&field))
+        {
+            columns.childRows[firstRow + i] = (uint32_t)columns.offsets.size();
+            columns.childCounts[firstRow + i] = (uint32_t)child->fieldsCount;
+            AppendColumns(columns, child, baseOffset + field.offset);
+        }
+    }
+}
+void FinalizeLayout(FormatLayout* layout)
+{
+    layout->fingerprint = ComputeLayoutFingerprint(layout);
+    layout->columns = {};
+    AppendColumns(layout->columns, layout, 0);
+}
+bool IsLayoutFinalized(const FormatLayout* layout)
+{
+    return layout->fingerprint != 0 && layout->columns.offsets.size() >= layout->fieldsCount;
+}
+bool IsForeignEndian(const FormatLayout* layout)
+{
+    return layout->endianness != Endianness::LITTLE;
+}
+uint32_t GetStoredMagic(const FormatLayout* layout)
+{
+    uint32_t magic = layout->magic;
+    if (IsForeignEndian(layout))
+    {
+        ByteSwap32((char*)&magic, 1);
+    }
+    return magic;
+}
+// next row in [start, count) with this name id, or count if there isn't one
+static size_t FindNameId(const uint32_t* ids, size_t start, size_t count, uint32_t id)
+{
+    size_t i = start;
+#if BINMERGE_SSE2
+    const __m128i needle = _mm_set1_epi32((int)id);
+    for (; i + 4 <= count; i += 4)
+    {
+        const int hits = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(ids + i)), needle)));
+        if (hits)
+        {
+            return i + CountTrailingZeros64((uint64_t)hits);
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        if (ids[i] == id)
+        {
+            return i;
+        }
+    }
+    return count;
+}
+const FieldData* DoesFormatHaveField(const FormatLayout* layout, const FormatLayout* fieldLayout, size_t fieldRow, uint32_t* fieldIndexOut)
+{
+    assert(IsLayoutFinalized(layout) && IsLayoutFinalized(fieldLayout));
+    const LayoutColumns& fieldColumns = fieldLayout->columns;
+    const uint32_t id = fieldColumns.nameIds[fieldRow];
+    const LayoutColumns& columns = layout->columns;
+    for (size_t i = FindNameId(columns.nameIds.data(), 0, layout->fieldsCount, id); i < layout->fieldsCount;
+         i = FindNameId(columns.nameIds.data(), i + 1, layout->fieldsCount, id))
+    {
+        // same name, now the rest of AreFieldsSame
+        if (columns.sizes[i] == fieldColumns.sizes[fieldRow] && columns.bitWidths[i] == fieldColumns.bitWidths[fieldRow])
+        {
+            if (fieldIndexOut) { *fieldIndexOut = (uint32_t)i; }
+            return &layout->fields[i];
+        }
+    }
+    return nullptr;
+}
+void PrintMe(FormatLayout* layout)
+{
+    printf("magic: %u", layout->magic);
+    printf("num fields: %zu", layout->fieldsCount);
+    for (size_t i = 0; i < layout->fieldsCount; i++)
+    {
+        printf("field: %s\n", layout->fields[i].name);
+        printf("size: %zu", layout->fields[i].size);
+        printf("data as str: %.*s\n", (int)layout->fields[i].size, layout->fields[i].data);
+    }
+}
+void PrintFieldValue(const FormatLayout* layout, const FieldData* field, const char* data)
+{
+    if (IsFieldBitfield(field))
+    {
+        const uint64_t unit = ReadUnsignedField(data, field->size, layout->endianness);
+        printf("%llu", (unsigned long long)((unit & GetBitfieldMask(field)) >> field->bitPosition));
+        return;
+    }
+    const Type type = field->type == ARRAY ? field->elementType : field->type;
+    const size_t count = field->type == ARRAY && field->elementCount ? field->elementCount : 1;
+    const size_t width = field->size / count;
+    if (type == CSTRING)
+    {
+        printf("\"%.*s\"", (int)strnlen(data, field->size), data);
+        return;
+    }
+    if (!IsSwappedType(type) || (width != 2 && width != 4 && width != 8))
+    {
+        for (size_t i = 0; i < field->size; i++)
+        {
+            printf("%02x", (uint8_t)data[i]);
+        }
+        return;
+    }
+    // swap a copy of the whole field in one go, rather than each value as we print it
+    char values[256];
+    const size_t printed = std::min(count, sizeof(values) / width);
+    memcpy(values, data, printed * width);
+    if (IsForeignEndian(layout))
+    {
+        ByteSwapValues(values, width, printed);
+    }
+    for (size_t i = 0; i < printed; i++)
+    {
+        const char* value = values + i * width;
+        if (i)
+        {
+            printf(" ");
+        }
+        if (type == FLOAT && width == 4)
+        {
+            float f;
+            memcpy(&f, value, sizeof(f));
+            printf("%g", f);
+        }
+        else if (type == DOUBLE && width == 8)
+        {
+            double d;
+            memcpy(&d, value, sizeof(d));
+            printf("%g", d);
+        }
+        else
+        {
+            int64_t v = 0;
+            switch (width)
+            {
+                case 2: { int16_t x; memcpy(&x, value, 2); v = x; } break;
+                case 4: { int32_t x; memcpy(&x, value, 4); v = x; } break;
+                case 8: { memcpy(&v, value, 8); } break;
+            }
+            printf("%lld", (long long)v);
+        }
+    }
+    if (printed < count)
+    {
+        printf(" ...");
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "type_enumeration.h"
+
+
+// since we are merging at the "field granularity", we will never
+// need to do an intelligent merge inside of a field itself. (unless maybe the field is itself another structure?)
+// For that reason, we can treat any field as being uniquely identified by it's name (and size).
+// then, the data for the field is just an opaque sized buffer
+constexpr uint32_t INVALID_FIELD_INDEX = UINT32_MAX;
+struct FieldData
+{
+    size_t size = 0; // size 0 means "empty field"
+    size_t offset = 0; // byte offset of the field from the start of the file (the magic lives at offset 0)
+    Type type = BYTE; // how the bytes should be interpreted when comparing. BYTE just means "opaque"
+    Type elementType = BYTE; // only for ARRAY fields
+    uint32_t elementCount = 0; // only for ARRAY fields. Element size is size / elementCount
+    // variable length fields: the number of elements is the (integer) value of another field in the file,
+    // and size is the size of a single element. These don't live at "offset", they're stored back to back
+    // after the fixed part of the file, in field order. A SIZEDBUFFER is just a variable field of 1 byte elements.
+    uint32_t countField = INVALID_FIELD_INDEX;
+    // offset fields: this field's value is a byte offset into the data of another (variable length) field,
+    // like an index into a string pool
+    uint32_t targetField = INVALID_FIELD_INDEX;
+    // bitfields: the field is bitWidth bits of the integer stored at offset (size bytes),
+    // starting bitPosition bits up from its least significant bit. Neighbouring bitfields share that integer
+    // (the "storage unit"), so several fields can have the same offset. bitWidth 0 means "not a bitfield"
+    uint8_t bitPosition = 0;
+    uint8_t bitWidth = 0;
+    char* data = nullptr; // in layout metadata, if set, this is the default value used when the field is newly introduced
+    #define MAX_IDENTIFIER_LENGTH (2048) // this is the actual *max* for most compilers, reasonably, it could be smaller
+    char name[MAX_IDENTIFIER_LENGTH] = {0};
+};
+bool AreFieldsSame(const FieldData* first, const FieldData* second);
+bool IsFieldEmpty(const FieldData* field);
+
+bool IsFieldVariable(const FieldData* field);
+bool IsFieldBitfield(const FieldData* field);
+// width bits starting at position
+uint64_t MakeBitMask(uint8_t position, uint8_t width);
+// the field's bits within its storage unit
+uint64_t GetBitfieldMask(const FieldData* field);
+// STRUCTURE fields can describe their insides with another layout, stored in "data". nullptr if there isn't one
+const struct FormatLayout* GetChildLayout(const FieldData* field);
+
+// byte order the numbers in a file are stored in. The magic is stored this way too.
+// We only ever run on little endian hosts, so BIG means "has to be swapped before we can look at it"
+enum class Endianness : uint8_t
+{
+    LITTLE,
+    BIG,
+};
+
+// hot copy of a layout's fields, one array per property, built by FinalizeLayout.
+// FieldData is the full description, but it's big (mostly the 2KB name), so a loop that only wants offsets
+// and sizes strides over kilobytes per field and misses cache on every one. Scans go over these instead,
+// and only touch the columns they use.
+// Rows [0, fieldsCount) are the layout's own fields in field order, so row i is fields[i] (and kernels[i]).
+// Nested STRUCTURE layouts are flattened after them, in pre-order: each nested layout's fields get a contiguous
+// run of rows, followed by the runs of their own nested layouts. childRows/childCounts point a STRUCTURE row at its run
+constexpr uint8_t FIELD_FLAG_VARIABLE = 1;
+constexpr uint8_t FIELD_FLAG_BITFIELD = 2;
+struct LayoutColumns
+{
+    std::vector<size_t> offsets = {}; // from the start of the file, nested rows included
+    std::vector<size_t> sizes = {};
+    std::vector<Type> types = {};
+    std::vector<uint8_t> flags = {};
+    std::vector<uint8_t> bitWidths = {};
+    std::vector<uint32_t> nameIds = {}; // see InternFieldName
+    std::vector<uint32_t> childRows = {}; // INVALID_FIELD_INDEX if the row has no nested layout
+    std::vector<uint32_t> childCounts = {};
+    std::vector<const FieldData*> fields = {}; // the full description, for anything cold (names, defaults, counts)
+};
+
+struct FormatLayout
+{
+    uint32_t magic = 0;
+    size_t fieldsCount = 0;
+    FieldData* fields;
+    // hash of everything structural about the layout (see ComputeLayoutFingerprint).
+    // Two layouts with the same fingerprint can have their data merged without diffing their structure.
+    // 0 means "not computed yet", call FinalizeLayout once the layout is loaded
+    uint64_t fingerprint = 0;
+    Endianness endianness = Endianness::LITTLE;
+    LayoutColumns columns = {}; // empty until FinalizeLayout
+};
+// field names are interned once, so comparing names is comparing two integers.
+// Ids are only meaningful within one run of the program
+uint32_t InternFieldName(const char* name);
+// the rows of a STRUCTURE row's nested layout, if it has one that can be merged member by member.
+// Bitfields and variable length fields are only merged at the top level, so a nested layout with any of
+// those in it (directly) returns false, and the whole structure is merged as one value
+bool GetMergeableChildRows(const LayoutColumns& columns, size_t row, size_t* firstRowOut, size_t* rowCountOut);
+// sum of the sizes of the fixed fields. Variable length fields aren't known until we look at a file (see file_index.h)
+size_t GetStructureSize(FormatLayout* layout);
+// size of the fixed part of a file described by this layout. Unlike GetStructureSize, this accounts for
+// the magic at the start of the file and any padding between fields
+size_t GetLayoutExtent(const FormatLayout* layout);
+// field names, sizes, offsets, types and any nested layouts, in field order. Not the magic
+uint64_t ComputeLayoutFingerprint(const FormatLayout* layout);
+// anything derived from the layout that we only want to compute once (fingerprint, columns).
+// Call after loading/building a layout, everything below that scans fields needs it
+void FinalizeLayout(FormatLayout* layout);
+bool IsLayoutFinalized(const FormatLayout* layout);
+bool IsForeignEndian(const FormatLayout* layout);
+// the magic the way it shows up in the first 4 bytes of a file, read as a native uint32_t
+uint32_t GetStoredMagic(const FormatLayout* layout);
+// looks for row fieldRow of fieldLayout (same name, size and bit width, see AreFieldsSame) among layout's own fields.
+// Both layouts have to be finalized, the names are matched by their interned ids
+const FieldData* DoesFormatHaveField(const FormatLayout* layout, const FormatLayout* fieldLayout, size_t fieldRow, uint32_t* fieldIndexOut = nullptr);
+void PrintMe(FormatLayout* layout);
+// prints the value of field as stored in a file (no newline). Numbers are swapped to native first
+void PrintFieldValue(const FormatLayout* layout, const FieldData* field, const char* data);
@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "format_registry.h"
+
+
+static uint32_t GetSlot(uint32_t magic, uint32_t multiplier, uint32_t shift)
+{
+    // multiplicative hashing: the top bits of the product are the best mixed
+    return shift >= 32 ? 0 : (uint32_t)(magic * multiplier) >> shift;
+}
+
+bool BuildFormatRegistry(FormatRegistry& registry, FormatLayout* const* layouts, size_t layoutCount)
+{
+    for (size_t i = 0; i < layoutCount; i++)
+    {
+        for (size_t j = i + 1; j < layoutCount; j++)
+        {
+            // what matters is the bytes at the front of the file, so a big endian layout can clash with a little endian one
+            if (GetStoredMagic(layouts[i]) == GetStoredMagic(layouts[j]))
+            {
+                printf("two layouts share the magic %08x, can't tell their files apart\n", GetStoredMagic(layouts[i]));
+                return false;
+            }
+        }
+        FinalizeLayout(layouts[i]);
+    }
+
+    // start with a table twice the size of the bundle, and keep doubling until some multiplier works.
+    // With a load factor of 1/2 that usually takes a handful of tries
+    uint32_t bits = 1;
+    while ((1ull << bits) < layoutCount * 2)
+    {
+        bits++;
+    }
+    uint32_t multiplier = 0x9E3779B1u; // golden ratio, then just walk through odd numbers from there
+    for (;; bits++)
+    {
+        const uint32_t shift = 32 - bits;
+        std::vector<FormatLayout*> slots((size_t)1 << bits, nullptr);
+        for (uint32_t attempt = 0; attempt < 256; attempt++, multiplier += 2)
+        {
+            std::fill(slots.begin(), slots.end(), nullptr);
+            bool collided = false;
+            for (size_t i = 0; i < layoutCount && !collided; i++)
+            {
+                FormatLayout*& slot = slots[GetSlot(GetStoredMagic(layouts[i]), multiplier, shift)];
+                collided = slot != nullptr;
+                slot = layouts[i];
+            }
+            if (!collided)
+            {
+                registry.slots = std::move(slots);
+                registry.multiplier = multiplier;
+                registry.shift = shift;
+                registry.count = layoutCount;
+                return true;
+            }
+        }
+    }
+}
+
+FormatLayout* FindFormatByMagic(const FormatRegistry& registry, uint32_t magic)
+{
+    if (registry.slots.empty())
+    {
+        return nullptr;
+    }
+    FormatLayout* layout = registry.slots[GetSlot(magic, registry.multiplier, registry.shift)];
+    // the slot only tells us "if it's registered, it's here", still have to check it's actually this magic
+    return layout && GetStoredMagic(layout) == magic ? layout : nullptr;
+}
+
+FormatLayout* FindFormatForFile(const FormatRegistry& registry, const char* data, size_t len)
+{
+    uint32_t magic = 0;
+    if (len < sizeof(magic))
+    {
+        return nullptr;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    return FindFormatByMagic(registry, magic);
+}
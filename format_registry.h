@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "format_layout.h"
+
+
+// every layout the merge driver knows about, keyed by magic.
+// A file's first 4 bytes are its magic, so picking the schema for an input file is a single lookup.
+// The table is a perfect hash built once at startup: we search for a multiplier that sends
+// every registered magic to its own slot, so a lookup is one multiply, one shift and one compare.
+struct FormatRegistry
+{
+    std::vector<FormatLayout*> slots = {}; // power of two sized, nullptr = empty
+    uint32_t multiplier = 0;
+    uint32_t shift = 0;
+    size_t count = 0;
+};
+
+// layouts is the "schema bundle": every layout we want to be able to merge.
+// Finalizes each layout. Fails (and prints why) if two layouts share a magic
+bool BuildFormatRegistry(FormatRegistry& registry, FormatLayout* const* layouts, size_t layoutCount);
+// magic is the first 4 bytes of a file read as a native uint32_t (see GetStoredMagic), so big endian layouts are found too
+FormatLayout* FindFormatByMagic(const FormatRegistry& registry, uint32_t magic);
+// reads the magic off the front of a file. nullptr if the file is too small or nobody registered that magic
+FormatLayout* FindFormatForFile(const FormatRegistry& registry, const char* data, size_t len);
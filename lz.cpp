@@ -0,0 +1,159 @@
+#include <cstdint>
+#include <cstring>
+
+#include "lz.h"
+
+
+static const size_t MinMatch = 4;
+static const size_t MaxDistance = 65535;
+static const uint32_t HashBits = 14;
+
+static inline uint32_t Read32(const char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t Hash4(const char* p)
+{
+    return (Read32(p) * 2654435761u) >> (32 - HashBits);
+}
+
+static char* WriteLength(char* dst, size_t length)
+{
+    // the first 15 went into the token
+    for (length -= 15; length >= 255; length -= 255)
+    {
+        *dst++ = (char)255;
+    }
+    *dst++ = (char)length;
+    return dst;
+}
+
+static char* WriteSequence(char* dst, const char* literals, size_t literalCount, size_t distance, size_t matchLength)
+{
+    char* token = dst++;
+    const size_t matchCode = matchLength ? matchLength - MinMatch : 0;
+    *token = (char)(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+    if (literalCount >= 15)
+    {
+        dst = WriteLength(dst, literalCount);
+    }
+    memcpy(dst, literals, literalCount);
+    dst += literalCount;
+    if (matchLength)
+    {
+        *dst++ = (char)(distance & 0xFF);
+        *dst++ = (char)(distance >> 8);
+        if (matchCode >= 15)
+        {
+            dst = WriteLength(dst, matchCode);
+        }
+    }
+    return dst;
+}
+
+size_t LzCompressBound(size_t srcSize)
+{
+    // all literals: a token, the length bytes, and the literals themselves
+    return srcSize + srcSize / 255 + 16;
+}
+
+size_t LzCompress(const char* src, size_t srcSize, char* dst)
+{
+    // most recent position for each hash of 4 bytes. Positions are stored + 1 so 0 means "nothing yet"
+    static thread_local uint32_t table[1u << HashBits];
+    memset(table, 0, sizeof(table));
+
+    char* out = dst;
+    size_t anchor = 0; // start of the literals that haven't been written yet
+    size_t pos = 0;
+    while (srcSize >= MinMatch && pos <= srcSize - MinMatch)
+    {
+        const uint32_t hash = Hash4(src + pos);
+        const size_t candidate = table[hash];
+        table[hash] = (uint32_t)(pos + 1);
+        if (!candidate || pos - (candidate - 1) > MaxDistance || Read32(src + candidate - 1) != Read32(src + pos))
+        {
+            pos++;
+            continue;
+        }
+        const size_t match = candidate - 1;
+        size_t length = MinMatch;
+        while (pos + length < srcSize && src[match + length] == src[pos + length])
+        {
+            length++;
+        }
+        out = WriteSequence(out, src + anchor, pos - anchor, pos - match, length);
+        pos += length;
+        anchor = pos;
+    }
+    return (size_t)(WriteSequence(out, src + anchor, srcSize - anchor, 0, 0) - dst);
+}
+
+static bool ReadLength(const char*& src, const char* end, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (src >= end)
+        {
+            return false;
+        }
+        byte = (uint8_t)*src++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool LzDecompress(const char* src, size_t srcSize, char* dst, size_t dstSize)
+{
+    const char* end = src + srcSize;
+    size_t out = 0;
+    while (src < end)
+    {
+        const uint8_t token = (uint8_t)*src++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(src, end, literalCount))
+        {
+            return false;
+        }
+        if (literalCount > (size_t)(end - src) || literalCount > dstSize - out)
+        {
+            return false;
+        }
+        memcpy(dst + out, src, literalCount);
+        src += literalCount;
+        out += literalCount;
+        if (src == end)
+        {
+            break; // the last sequence has no match
+        }
+
+        if (end - src < 2)
+        {
+            return false;
+        }
+        const size_t distance = (uint8_t)src[0] | ((size_t)(uint8_t)src[1] << 8);
+        src += 2;
+        size_t length = token & 0xF;
+        if (length == 15 && !ReadLength(src, end, length))
+        {
+            return false;
+        }
+        length += MinMatch;
+        if (distance == 0 || distance > out || length > dstSize - out)
+        {
+            return false;
+        }
+        // the match can overlap what it's writing (that's how runs are encoded), so no memcpy
+        const char* from = dst + out - distance;
+        for (size_t i = 0; i < length; i++)
+        {
+            dst[out + i] = from[i];
+        }
+        out += length;
+    }
+    return out == dstSize;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+
+// small LZ77 codec for container blocks, so we don't need zlib/lz4/zstd just to read our own assets.
+// The block format is a list of sequences: a token byte (high nibble literal count, low nibble match length - 4,
+// 15 in either means extra length bytes follow, each adding up to 255), the literals, then a 2 byte
+// little endian distance back into the output for the match. The last sequence is literals only.
+
+// worst case output size for srcSize bytes of input (incompressible data grows a little)
+size_t LzCompressBound(size_t srcSize);
+// returns the compressed size. dst must be at least LzCompressBound(srcSize) bytes
+size_t LzCompress(const char* src, size_t srcSize, char* dst);
+// returns false if src isn't a valid block, or doesn't decompress to exactly dstSize bytes
+bool LzDecompress(const char* src, size_t srcSize, char* dst, size_t dstSize);
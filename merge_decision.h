@@ -0,0 +1,69 @@
+#pragma once
+
+
+/* 
+https://homes.cs.washington.edu/~mernst/pubs/merge-evaluation-ase2024.pdf
+The resolution phase of three-way merging uses the following
+algorithm. For each change C in a 3-way diff, let C1 be the difference
+between the base and parent 1 and let C2 be the difference between
+the base and parent 2. C1 and C2 are at the same location in the
+source code.
+• If C1 is the same as C2, use it; equivalently, if parent 1 is the
+same as parent 2, use it.
+• If C1 is empty, use C2; equivalently, if the base is the same as
+parent 1, use parent 2.
+• If C2 is empty, use C1; equivalently, if the base is the same as
+parent 2, use parent 1.
+• If C1 differs from C2, report a conflict; equivalently, if the base,
+parent 1, and parent 2 all differ, report a conflict.
+
+All 8 combinations of the three comparisons, and what they resolve to
+(base=local, base=remote, local=remote):
+    yes yes yes   nothing changed                  TAKE_BASE
+    yes yes no    nothing changed, local=remote    TAKE_BASE
+                  wasn't worth comparing (callers
+                  skip it unless both sides changed)
+    yes no  yes   can't happen (base=local=remote  TAKE_LOCAL, which is
+                  but base!=remote)                base anyway
+    no  yes yes   can't happen, same reason        TAKE_LOCAL
+    yes no  no    only remote changed              TAKE_REMOTE
+    no  yes no    only local changed               TAKE_LOCAL
+    no  no  yes   both made the same change        TAKE_LOCAL
+    no  no  no    both changed, differently        CONFLICT
+The "can't happen" rows assume the comparison is an equivalence, which the
+compare kernels are. They're only listed so every input has an answer.
+*/
+
+enum class MergeDecision
+{
+    TAKE_BASE,
+    TAKE_LOCAL,
+    TAKE_REMOTE,
+    CONFLICT,
+};
+// the resolution rules from above, given which revisions compare equal
+inline MergeDecision ResolveModification(bool baseToLocal, bool baseToRemote, bool localToRemote)
+{
+    if (baseToLocal && baseToRemote)
+    {
+        // no changes
+        return MergeDecision::TAKE_BASE;
+    }
+    if (localToRemote)
+    {
+        // same change, return that change
+        return MergeDecision::TAKE_LOCAL;
+    }
+    if (baseToLocal && !baseToRemote)
+    {
+        // base is same as local, but remote has different changes, so we merge remote changes here
+        return MergeDecision::TAKE_REMOTE;
+    }
+    if (!baseToLocal && baseToRemote)
+    {
+        // local differs from base, but remote is same, merge in local
+        return MergeDecision::TAKE_LOCAL;
+    }
+    // both local and remote have made *different* changes, this is a merge conflict
+    return MergeDecision::CONFLICT;
+}
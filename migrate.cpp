@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#include "file_index.h"
+#include "migrate.h"
+#include "parallel.h"
+#include "pdb/mapped_file.h"
+
+
+// the variable length fields of a layout, in the order their data sits in the tail
+static std::vector<const FieldData*> GetVariableFields(const FormatLayout& layout)
+{
+    std::vector<const FieldData*> fields = {};
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        if (IsFieldVariable(&layout.fields[i]))
+        {
+            fields.push_back(&layout.fields[i]);
+        }
+    }
+    return fields;
+}
+
+MigrationPlan CompileMigration(const FormatLayout& from, const FormatLayout& to)
+{
+    MigrationPlan plan = {};
+    plan.srcMagic = GetStoredMagic(&from);
+    plan.dstMagic = GetStoredMagic(&to);
+    plan.srcEndianness = from.endianness;
+    plan.dstEndianness = to.endianness;
+    const bool changesEndianness = from.endianness != to.endianness;
+    plan.srcExtent = GetLayoutExtent(&from);
+    plan.dstExtent = GetLayoutExtent(&to);
+
+    // fields are matched the same way the merge matches them: by name and size.
+    // Anything in "to" that isn't in "from" is an added field and gets filled.
+    // Anything in "from" that isn't in "to" was removed, and just never gets copied.
+    // Variable length fields are stored after the fixed part, so they ride along with the tail of the file.
+    // That only holds up as long as the set of variable fields didn't change between the two layouts.
+    const std::vector<const FieldData*> srcVariable = GetVariableFields(from);
+    const std::vector<const FieldData*> dstVariable = GetVariableFields(to);
+    if (srcVariable.size() != dstVariable.size())
+    {
+        printf("can't migrate %08x to %08x: %zu variable length fields in one, %zu in the other\n",
+            from.magic, to.magic, srcVariable.size(), dstVariable.size());
+        return plan;
+    }
+    for (size_t i = 0; i < srcVariable.size(); i++)
+    {
+        const FieldData* src = srcVariable[i];
+        const FieldData* dst = dstVariable[i];
+        if (strcmp(src->name, dst->name) != 0 || src->type != dst->type || src->size != dst->size)
+        {
+            printf("can't migrate %08x to %08x: variable length field %s doesn't match %s in the new layout, they need the same name, type and size\n",
+                from.magic, to.magic, src->name, dst->name);
+            return plan;
+        }
+    }
+
+    std::vector<const FieldData*> swapFields = {};
+    for (size_t i = 0; i < to.fieldsCount; i++)
+    {
+        const FieldData* dstField = &to.fields[i];
+        if (IsFieldVariable(dstField))
+        {
+            if (changesEndianness)
+            {
+                // the tail is swapped value by value, there's nothing to say where the values in a structure are
+                if (dstField->type == STRUCTURE)
+                {
+                    printf("can't migrate %08x to %08x: %s holds structures, there's no telling how to change their byte order\n",
+                        from.magic, to.magic, dstField->name);
+                    return plan;
+                }
+                plan.swapTailLayout = &to;
+            }
+            continue;
+        }
+        const FieldData* srcField = DoesFormatHaveField(&from, &to, i);
+        // copied across byte orders, an opaque structure would come out with its values still in the old order
+        if (srcField && changesEndianness && (!CanSwapField(*srcField) || !CanSwapField(*dstField)))
+        {
+            printf("can't migrate %08x to %08x: %s is a structure without a layout, there's no telling how to change its byte order\n",
+                from.magic, to.magic, dstField->name);
+            return plan;
+        }
+        if (IsFieldBitfield(dstField))
+        {
+            // bit moves read and write the storage units in each layout's own byte order, so no swaps needed
+            if (srcField)
+            {
+                plan.bitMoves.push_back({ srcField->offset, dstField->offset, dstField->size, srcField->bitPosition, dstField->bitPosition, dstField->bitWidth });
+            }
+            else if (dstField->data)
+            {
+                // a bitfield's default is its value as a native integer the size of the storage unit
+                const uint64_t value = ReadUnsignedField(dstField->data, dstField->size);
+                plan.bitFills.push_back({ dstField->offset, dstField->size, dstField->bitPosition, dstField->bitWidth, value });
+            }
+            continue;
+        }
+        if (srcField)
+        {
+            plan.moves.push_back({ srcField->offset, dstField->offset, dstField->size });
+            if (changesEndianness)
+            {
+                swapFields.push_back(dstField);
+            }
+        }
+        else
+        {
+            // a STRUCTURE's data is its nested layout, not a default value
+            const char* defaultData = GetChildLayout(dstField) ? nullptr : dstField->data;
+            plan.fills.push_back({ dstField->offset, dstField->size, defaultData });
+            // defaults are written in native byte order
+            if (defaultData && IsForeignEndian(&to))
+            {
+                swapFields.push_back(dstField);
+            }
+        }
+    }
+    // "to" order isn't offset order, collect them all first so neighbours still share a run
+    plan.swaps = CompileSwapRuns(swapFields.data(), swapFields.size());
+
+    // unchanged stretches of the layout turn into one field-per-move. Collapse runs of fields that
+    // sit next to each other in both layouts, so unchanged stretches become a single memcpy.
+    // Worst case (every field reordered) we just end up with one move per field.
+    std::sort(plan.moves.begin(), plan.moves.end(), [](const MigrationMove& a, const MigrationMove& b)
+    {
+        return a.srcOffset < b.srcOffset;
+    });
+    std::vector<MigrationMove> coalesced = {};
+    for (const MigrationMove& move : plan.moves)
+    {
+        if (!coalesced.empty())
+        {
+            MigrationMove& prev = coalesced.back();
+            if (prev.srcOffset + prev.size == move.srcOffset && prev.dstOffset + prev.size == move.dstOffset)
+            {
+                prev.size += move.size;
+                continue;
+            }
+        }
+        coalesced.push_back(move);
+    }
+    plan.moves = std::move(coalesced);
+    plan.valid = true;
+    return plan;
+}
+
+static void InsertBitfield(char* unit, size_t size, uint8_t bitPosition, uint8_t bitWidth, uint64_t value, Endianness endianness)
+{
+    const uint64_t mask = MakeBitMask(bitPosition, bitWidth);
+    const uint64_t current = ReadUnsignedField(unit, size, endianness);
+    WriteUnsignedField(unit, size, (current & ~mask) | ((value << bitPosition) & mask), endianness);
+}
+
+bool IsMigrationSource(const MigrationPlan& plan, const char* src, size_t srcLen)
+{
+    uint32_t magic = 0;
+    if (srcLen < sizeof(magic))
+    {
+        return false;
+    }
+    memcpy(&magic, src, sizeof(magic));
+    return magic == plan.srcMagic;
+}
+
+// ApplyMigration once src is known to be a migration source
+static bool MigrateFile(const MigrationPlan& plan, const char* src, size_t srcLen, std::vector<char>& dst)
+{
+    if (srcLen < plan.srcExtent)
+    {
+        return false;
+    }
+
+    const size_t tailSize = srcLen - plan.srcExtent;
+    dst.assign(plan.dstExtent + tailSize, 0); // zero so padding and zero-filled fields don't need extra work
+    memcpy(dst.data(), &plan.dstMagic, sizeof(plan.dstMagic));
+    for (const MigrationMove& move : plan.moves)
+    {
+        memcpy(dst.data() + move.dstOffset, src + move.srcOffset, move.size);
+    }
+    for (const MigrationFill& fill : plan.fills)
+    {
+        if (fill.defaultData)
+        {
+            memcpy(dst.data() + fill.dstOffset, fill.defaultData, fill.size);
+        }
+    }
+    if (tailSize)
+    {
+        memcpy(dst.data() + plan.dstExtent, src + plan.srcExtent, tailSize);
+    }
+    for (const MigrationBitMove& move : plan.bitMoves)
+    {
+        const uint64_t srcMask = MakeBitMask(move.srcBitPosition, move.bitWidth);
+        const uint64_t value = (ReadUnsignedField(src + move.srcOffset, move.size, plan.srcEndianness) & srcMask) >> move.srcBitPosition;
+        InsertBitfield(dst.data() + move.dstOffset, move.size, move.dstBitPosition, move.bitWidth, value, plan.dstEndianness);
+    }
+    for (const MigrationBitFill& fill : plan.bitFills)
+    {
+        InsertBitfield(dst.data() + fill.dstOffset, fill.size, fill.dstBitPosition, fill.bitWidth, fill.value, plan.dstEndianness);
+    }
+    ApplySwapRuns(plan.swaps.data(), plan.swaps.size(), dst.data());
+    if (plan.swapTailLayout)
+    {
+        // the counts are in the new byte order by now, so the new layout can find its way around
+        const FormatLayout& layout = *plan.swapTailLayout;
+        FileIndex index = {};
+        if (!BuildFileIndex(layout, dst.data(), dst.size(), index))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < layout.fieldsCount; i++)
+        {
+            const FieldData& field = layout.fields[i];
+            if (IsFieldVariable(&field) && IsSwappedType(field.type))
+            {
+                ByteSwapValues(dst.data() + index.fields[i].offset, field.size, index.fields[i].count);
+            }
+        }
+    }
+    return true;
+}
+
+bool ApplyMigration(const MigrationPlan& plan, const char* src, size_t srcLen, std::vector<char>& dst)
+{
+    return plan.valid && IsMigrationSource(plan, src, srcLen) && MigrateFile(plan, src, srcLen, dst);
+}
+
+MigrationStats MigrateDirectory(const MigrationPlan& plan, const char* directory, uint32_t threadCount)
+{
+    namespace fs = std::filesystem;
+    MigrationStats stats = {};
+    if (!plan.valid)
+    {
+        return stats;
+    }
+
+    std::error_code ec;
+    std::vector<fs::path> paths = {};
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(directory, ec))
+    {
+        if (entry.is_regular_file(ec))
+        {
+            paths.push_back(entry.path());
+        }
+    }
+    if (ec)
+    {
+        printf("failed to walk %s: %s\n", directory, ec.message().c_str());
+    }
+
+    // files are independent of each other, so each one is a job of its own
+    std::atomic<size_t> migrated = 0;
+    std::atomic<size_t> skipped = 0;
+    std::atomic<size_t> failed = 0;
+    // one per worker, reused across files so we aren't reallocating per file
+    std::vector<std::vector<char>> scratches(GetParallelWorkerCount(paths.size(), threadCount));
+    ParallelFor(paths.size(), threadCount, [&](size_t i, uint32_t worker)
+    {
+        std::vector<char>& scratch = scratches[worker];
+        const fs::path& path = paths[i];
+        MemoryMappedFile::Handle file = MemoryMappedFile::Open(path.string().c_str());
+        if (!file.baseAddress)
+        {
+            failed++;
+            return;
+        }
+        // the magic check is what tells skipped from failed, so it happens out here and not in ApplyMigration
+        const bool ours = IsMigrationSource(plan, (const char*)file.baseAddress, file.len);
+        const bool applied = ours && MigrateFile(plan, (const char*)file.baseAddress, file.len, scratch);
+        MemoryMappedFile::Close(file);
+        if (!ours)
+        {
+            skipped++;
+            return;
+        }
+        if (!applied)
+        {
+            // our magic, but the rest of it doesn't fit the layout. That's a broken file, not someone else's
+            printf("failed to migrate %s, it doesn't fit the layout\n", path.string().c_str());
+            failed++;
+            return;
+        }
+
+        // write next to the original, then swap it in, so a crash never leaves a half-written asset
+        fs::path tmpPath = path;
+        tmpPath += ".migrating";
+        FILE* out = fopen(tmpPath.string().c_str(), "wb");
+        bool written = out && fwrite(scratch.data(), 1, scratch.size(), out) == scratch.size();
+        if (out)
+        {
+            written = (fclose(out) == 0) && written;
+        }
+        std::error_code renameEc;
+        if (written)
+        {
+            fs::rename(tmpPath, path, renameEc);
+        }
+        if (!written || renameEc)
+        {
+            printf("failed to write migrated %s\n", path.string().c_str());
+            fs::remove(tmpPath, renameEc);
+            failed++;
+            return;
+        }
+        migrated++;
+    });
+
+    stats.migrated = migrated;
+    stats.skipped = skipped;
+    stats.failed = failed;
+    return stats;
+}
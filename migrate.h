@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "byteswap.h"
+#include "format_layout.h"
+
+
+// migrating is the "schema changed, data didn't" case. Rather than merging three revisions,
+// we take a file written with some old layout and rewrite it so it matches a new layout.
+// The old->new relationship between two layouts is the same for every file, so we
+// work it out once up front ("compile" it) into a list of byte range copies and fills,
+// and then just blast that list over every file.
+
+// a contiguous run of bytes that exists in both layouts. Copied from the old file into the new one
+struct MigrationMove
+{
+    size_t srcOffset = 0;
+    size_t dstOffset = 0;
+    size_t size = 0;
+};
+// a run of bytes in the new layout that has no counterpart in the old one (added fields)
+struct MigrationFill
+{
+    size_t dstOffset = 0;
+    size_t size = 0;
+    const char* defaultData = nullptr; // nullptr means zero-fill
+};
+// bitfields share their storage unit with their neighbours, so they can't be moved as whole bytes.
+// Each one is pulled out of the old unit and inserted into the new one on its own
+struct MigrationBitMove
+{
+    size_t srcOffset = 0;
+    size_t dstOffset = 0;
+    size_t size = 0; // of the storage unit, the same in both layouts
+    uint8_t srcBitPosition = 0;
+    uint8_t dstBitPosition = 0;
+    uint8_t bitWidth = 0;
+};
+// an added bitfield with a default value
+struct MigrationBitFill
+{
+    size_t dstOffset = 0;
+    size_t size = 0;
+    uint8_t dstBitPosition = 0;
+    uint8_t bitWidth = 0;
+    uint64_t value = 0;
+};
+struct MigrationPlan
+{
+    uint32_t srcMagic = 0;
+    uint32_t dstMagic = 0;
+    size_t srcExtent = 0;
+    size_t dstExtent = 0;
+    std::vector<MigrationMove> moves = {};
+    std::vector<MigrationFill> fills = {};
+    std::vector<MigrationBitMove> bitMoves = {};
+    std::vector<MigrationBitFill> bitFills = {};
+    Endianness srcEndianness = Endianness::LITTLE;
+    Endianness dstEndianness = Endianness::LITTLE;
+    // values that have to change byte order on the way: everything copied between layouts of different
+    // endianness, and defaults going into a big endian layout. Applied after the moves and fills
+    std::vector<SwapRun> swaps = {};
+    // set when the variable length fields in the tail have to change byte order too.
+    // Where they are depends on each file's counts, so the new file gets indexed with this layout first
+    const FormatLayout* swapTailLayout = nullptr;
+    // false if CompileMigration refused the two layouts (it printed why). Nothing gets migrated with an invalid plan
+    bool valid = false;
+};
+
+// the plan is one-way. For the "down" direction, compile again with the layouts swapped.
+// Both layouts have to be finalized (FinalizeLayout).
+// The variable length fields are carried over as the tail of the file, untouched, so both layouts need the same ones
+// (same count, order, names, types and element sizes). If they don't, the plan comes back invalid.
+// So does a change of endianness with a structure that has no nested layout in either file, its values can't be swapped
+MigrationPlan CompileMigration(const FormatLayout& from, const FormatLayout& to);
+// does src start with the plan's "from" magic. Anything that doesn't isn't ours to migrate
+bool IsMigrationSource(const MigrationPlan& plan, const char* src, size_t srcLen);
+// src is a whole file written with the plan's "from" layout. Any bytes past the end of
+// the old layout are carried over as-is after the end of the new one.
+// Checks IsMigrationSource itself, callers don't have to. Returns false for an invalid plan,
+// if src isn't a migration source, or if it claims to be but doesn't fit the layout
+bool ApplyMigration(const MigrationPlan& plan, const char* src, size_t srcLen, std::vector<char>& dst);
+
+struct MigrationStats
+{
+    size_t migrated = 0;
+    size_t skipped = 0; // not this format (magic mismatch), left untouched
+    size_t failed = 0; // couldn't be read/written, or has our magic but is broken (too short, bad tail index)
+};
+// migrates every file under directory (recursively) in place. Does nothing with an invalid plan.
+// threadCount 0 means use every hardware thread
+MigrationStats MigrateDirectory(const MigrationPlan& plan, const char* directory, uint32_t threadCount = 0);
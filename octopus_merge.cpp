@@ -0,0 +1,220 @@
+#include <assert.h>
+#include <cstdio>
+#include <cstring>
+
+#include "array_merge.h"
+#include "bitfield_merge.h"
+#include "octopus_merge.h"
+
+
+// the core of the N-way merge for one value. changed(r) says whether revision r changed it,
+// same(a, b) whether revisions a and b have the same value.
+// Returns the revision to take the value from, or -1 if nobody changed it
+template <typename Changed, typename Same>
+static int PickRevision(size_t revisionCount, const char* name, bool& result, Changed changed, Same same)
+{
+    int winner = -1;
+    for (size_t r = 0; r < revisionCount; r++)
+    {
+        if (!changed(r))
+        {
+            continue;
+        }
+        if (winner < 0)
+        {
+            winner = (int)r;
+        }
+        else if (!same((size_t)winner, r))
+        {
+            printf("conflict in field %s: revisions %d and %zu disagree\n", name, winner, r);
+            result = false;
+            break;
+        }
+    }
+    return winner;
+}
+
+// N-way MergeRecordRows (binmerge.cpp): rows [firstRow, firstRow + rowCount) of layout's columns
+static bool MergeRecordRowsN(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    size_t firstRow,
+    size_t rowCount,
+    const char* base,
+    const char* const* revisions,
+    size_t revisionCount,
+    char* merged,
+    bool& hasBitfields)
+{
+    const LayoutColumns& columns = layout.columns;
+    bool result = true;
+    std::vector<const char*> fieldRevisions(revisionCount);
+    for (size_t i = firstRow; i < firstRow + rowCount; i++)
+    {
+        const size_t offset = columns.offsets[i];
+        const size_t size = columns.sizes[i];
+        if (columns.flags[i] & FIELD_FLAG_VARIABLE)
+        {
+            continue;
+        }
+        if (columns.flags[i] & FIELD_FLAG_BITFIELD)
+        {
+            hasBitfields = true;
+            continue;
+        }
+        size_t childRow = 0;
+        size_t childCount = 0;
+        if (GetMergeableChildRows(columns, i, &childRow, &childCount))
+        {
+            result = MergeRecordRowsN(layout, kernels, childRow, childCount, base, revisions, revisionCount, merged, hasBitfields) && result;
+            continue;
+        }
+        FieldCompareFn compare = kernels[i];
+        const FieldData& field = *columns.fields[i];
+        if (columns.types[i] == ARRAY)
+        {
+            for (size_t r = 0; r < revisionCount; r++)
+            {
+                fieldRevisions[r] = revisions[r] + offset;
+            }
+            result = MergeArrayFieldN(field, compare, base + offset, fieldRevisions.data(), revisionCount, merged + offset) && result;
+            continue;
+        }
+        int winner = PickRevision(revisionCount, field.name, result,
+            [&](size_t r) { return !compare(base + offset, revisions[r] + offset, size); },
+            [&](size_t a, size_t b) { return compare(revisions[a] + offset, revisions[b] + offset, size); });
+        if (winner > 0)
+        {
+            memcpy(merged + offset, revisions[winner] + offset, size);
+        }
+    }
+    return result;
+}
+
+bool MergeRecordDataN(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    const char* base,
+    const char* const* revisions,
+    size_t revisionCount,
+    char* merged)
+{
+    assert(IsLayoutFinalized(&layout));
+    memcpy(merged, revisions[0], GetLayoutExtent(&layout));
+    bool hasBitfields = false;
+    bool result = MergeRecordRowsN(layout, kernels, 0, layout.fieldsCount, base, revisions, revisionCount, merged, hasBitfields);
+    if (hasBitfields)
+    {
+        BitfieldPlan plan = CompileBitfieldPlan(layout);
+        result = MergeBitfieldsN(layout, plan, base, revisions, revisionCount, merged) && result;
+    }
+    return result;
+}
+
+bool MergeFilesN(
+    const FormatLayout& layout,
+    const char* base, size_t baseLen,
+    const char* const* revisions, const size_t* revisionLens, size_t revisionCount,
+    std::vector<char>& merged,
+    bool* conflictsOut)
+{
+    if (revisionCount == 0)
+    {
+        return false;
+    }
+    // every structural diff against base happens here, once: a file index per revision
+    FileIndex baseIndex = {};
+    std::vector<FileIndex> indices(revisionCount);
+    if (!BuildFileIndex(layout, base, baseLen, baseIndex))
+    {
+        return false;
+    }
+    for (size_t r = 0; r < revisionCount; r++)
+    {
+        if (!BuildFileIndex(layout, revisions[r], revisionLens[r], indices[r]))
+        {
+            return false;
+        }
+    }
+
+    std::vector<FieldCompareFn> kernels = SelectCompareKernels(layout);
+    merged.resize(GetLayoutExtent(&layout));
+    bool result = MergeRecordDataN(layout, kernels.data(), base, revisions, revisionCount, merged.data());
+
+    std::vector<const char*> fieldRevisions(revisionCount);
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        const FieldData& field = layout.fields[i];
+        if (!IsFieldVariable(&field))
+        {
+            continue;
+        }
+        const IndexedField& baseField = baseIndex.fields[i];
+        const size_t mergedOffset = merged.size();
+        bool sameCount = field.type != SIZEDBUFFER;
+        for (size_t r = 0; r < revisionCount && sameCount; r++)
+        {
+            sameCount = indices[r].fields[i].count == baseField.count;
+        }
+        size_t mergedCount = baseField.count;
+        if (sameCount)
+        {
+            for (size_t r = 0; r < revisionCount; r++)
+            {
+                fieldRevisions[r] = revisions[r] + indices[r].fields[i].offset;
+            }
+            merged.insert(merged.end(), fieldRevisions[0], fieldRevisions[0] + indices[0].fields[i].size);
+            result = MergeArrayElementsN(field.name, kernels[i], field.size, baseField.count,
+                base + baseField.offset, fieldRevisions.data(), revisionCount, merged.data() + mergedOffset) && result;
+        }
+        else
+        {
+            // somebody resized it, so it's one value. Still compared element by element with the field's kernel,
+            // a -0.0 where base had 0.0 isn't a change
+            auto value = [&](size_t r) { return revisions[r] + indices[r].fields[i].offset; };
+            auto count = [&](size_t r) { return indices[r].fields[i].count; };
+            auto size = [&](size_t r) { return indices[r].fields[i].size; };
+            int winner = PickRevision(revisionCount, field.name, result,
+                [&](size_t r) { return !AreElementsSame(kernels[i], field.size, base + baseField.offset, baseField.count, value(r), count(r)); },
+                [&](size_t a, size_t b) { return AreElementsSame(kernels[i], field.size, value(a), count(a), value(b), count(b)); });
+            // nobody changed it: revisions[0]'s copy, like everything else in merged
+            const size_t source = winner < 0 ? 0 : (size_t)winner;
+            merged.insert(merged.end(), value(source), value(source) + size(source));
+            mergedCount = count(source);
+        }
+        const FieldData& countField = layout.fields[field.countField];
+        WriteUnsignedField(merged.data() + countField.offset, countField.size, mergedCount, layout.endianness);
+    }
+    std::vector<const FileIndex*> indexPointers(revisionCount);
+    for (size_t r = 0; r < revisionCount; r++)
+    {
+        indexPointers[r] = &indices[r];
+    }
+    result = CheckOffsetFields(layout, kernels.data(), base, baseIndex, revisions, indexPointers.data(), revisionCount) && result;
+
+    // whatever is left after the layout is one value. It has no type, so there's no kernel for it: raw bytes,
+    // same as the three-way merge compares it
+    auto tail = [&](size_t r) { return revisions[r] + indices[r].end; };
+    auto tailSize = [&](size_t r) { return revisionLens[r] - indices[r].end; };
+    const char* baseTail = base + baseIndex.end;
+    const size_t baseTailSize = baseLen - baseIndex.end;
+    int winner = PickRevision(revisionCount, "<tail>", result,
+        [&](size_t r) { return tailSize(r) != baseTailSize || !CompareBytes(baseTail, tail(r), baseTailSize); },
+        [&](size_t a, size_t b) { return tailSize(a) == tailSize(b) && CompareBytes(tail(a), tail(b), tailSize(a)); });
+    if (winner < 0)
+    {
+        merged.insert(merged.end(), baseTail, baseTail + baseTailSize);
+    }
+    else
+    {
+        merged.insert(merged.end(), tail(winner), tail(winner) + tailSize(winner));
+    }
+    FileIndex mergedIndex = {};
+    if (!BuildFileIndex(layout, merged.data(), merged.size(), mergedIndex))
+    {
+        printf("the merged result doesn't fit the layout\n");
+        return false;
+    }
+    if (conflictsOut) { *conflictsOut = !result; }
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "compare_kernels.h"
+#include "file_index.h"
+#include "format_layout.h"
+
+
+// merging several branches into an asset at once (git calls this an octopus merge).
+// Chaining three-way merges re-reads, re-diffs and re-writes the whole file for every branch. Instead,
+// every revision is diffed against the one base, and each field is resolved across all of them in one pass:
+// - nobody changed it: it stays as it was in base
+// - one or more revisions changed it, and they all agree: that's the new value
+// - two or more changed it to different things: conflict, the first revision that changed it wins
+// With two revisions (local, remote) that's exactly the three-way merge.
+// All revisions have to share the base's layout.
+
+// the fixed part of the file. merged starts out as a copy of revisions[0]
+bool MergeRecordDataN(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    const char* base,
+    const char* const* revisions,
+    size_t revisionCount,
+    char* merged);
+
+// the whole file, including variable length fields and anything past the end of the layout.
+// Returns false if a file (or the merged result) doesn't fit the layout. conflictsOut is set if anything conflicted
+bool MergeFilesN(
+    const FormatLayout& layout,
+    const char* base, size_t baseLen,
+    const char* const* revisions, const size_t* revisionLens, size_t revisionCount,
+    std::vector<char>& merged,
+    bool* conflictsOut);
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "output_writer.h"
+#include "sparse_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/falloc.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#else
+// we use std::min/std::max here, don't let the Windows macros eat them
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <winioctl.h>
+#endif
+
+
+// granularity of the diff. A changed byte costs us one block of writing, which is nothing next to
+// a syscall, and comparing whole blocks with memcmp is a lot faster than finding exact byte ranges
+static const size_t ChangedBlockSize = 4096;
+static const char ZeroBlock[ChangedBlockSize] = {};
+
+static bool IsZero(const char* data, size_t size)
+{
+    return memcmp(data, ZeroBlock, size) == 0;
+}
+
+void FindChangedRanges(const char* local, size_t localLen, const char* merged, size_t mergedLen, std::vector<ByteRange>& changed,
+    const std::vector<ByteRange>* localData)
+{
+    changed.clear();
+    const size_t sharedLen = std::min(localLen, mergedLen);
+    for (size_t offset = 0; offset < sharedLen; offset += ChangedBlockSize)
+    {
+        const size_t size = std::min(ChangedBlockSize, sharedLen - offset);
+        // a hole in local reads as zeros, no need to fault them in to find that out
+        const bool same = localData && IsAllHole(*localData, offset, size) ? IsZero(merged + offset, size) : memcmp(local + offset, merged + offset, size) == 0;
+        if (same)
+        {
+            continue;
+        }
+        if (!changed.empty() && changed.back().offset + changed.back().size == offset)
+        {
+            changed.back().size += size;
+        }
+        else
+        {
+            changed.push_back({ offset, size });
+        }
+    }
+    if (mergedLen > sharedLen)
+    {
+        if (!changed.empty() && changed.back().offset + changed.back().size == sharedLen)
+        {
+            changed.back().size += mergedLen - sharedLen;
+        }
+        else
+        {
+            changed.push_back({ sharedLen, mergedLen - sharedLen });
+        }
+    }
+}
+
+// writes one changed range through write(data, size, offset). Runs of whole zero blocks go to punch(offset, size)
+// instead, so zeroing something doesn't densify the file. punch returns false if it can't, then they're written after all
+template <typename Write, typename Punch>
+static bool WriteChangedRange(const char* merged, size_t offset, size_t size, Write&& write, Punch&& punch)
+{
+    const size_t end = offset + size;
+    auto isZeroBlock = [&](size_t at) { return end - at >= ChangedBlockSize && IsZero(merged + at, ChangedBlockSize); };
+    while (offset < end)
+    {
+        const bool zero = isZeroBlock(offset);
+        size_t runEnd = offset;
+        do
+        {
+            runEnd += std::min(ChangedBlockSize, end - runEnd);
+        } while (runEnd < end && isZeroBlock(runEnd) == zero);
+        if (!(zero && punch(offset, runEnd - offset)) && !write(merged + offset, runEnd - offset, offset))
+        {
+            return false;
+        }
+        offset = runEnd;
+    }
+    return true;
+}
+
+#ifndef _WIN32
+
+static bool WriteAll(int fd, const char* data, size_t size, size_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, data, size, (off_t)offset);
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= (size_t)written;
+        offset += (size_t)written;
+    }
+    return true;
+}
+
+// fills [offset, offset + size) of dst from the same range of src without it ever passing through user space.
+// Falls back to writing it from merged if the kernel can't do that for these two files
+static bool CopyUnchangedSpan(int src, int dst, const char* merged, size_t offset, size_t size)
+{
+#ifdef __linux__
+    off_t srcOffset = (off_t)offset;
+    off_t dstOffset = (off_t)offset;
+    while (size > 0)
+    {
+        ssize_t copied = copy_file_range(src, &srcOffset, dst, &dstOffset, size, 0);
+        if (copied <= 0)
+        {
+            // EXDEV on older kernels, ENOSYS, or a filesystem that just doesn't do it
+            break;
+        }
+        size -= (size_t)copied;
+    }
+    offset = (size_t)dstOffset;
+#else
+    (void)src;
+#endif
+    return WriteAll(dst, merged + offset, size, offset);
+}
+
+// deallocates [offset, offset + size), which then reads as zeros. false if the filesystem can't do that
+static bool PunchHole(int fd, size_t offset, size_t size)
+{
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)size) == 0;
+#else
+    (void)fd; (void)offset; (void)size;
+    return false;
+#endif
+}
+
+bool WriteMergedOutput(const char* localPath, const char* resultPath, const char* merged, size_t mergedLen, const std::vector<ByteRange>& changed,
+    const std::vector<ByteRange>* localData)
+{
+    struct stat localSb;
+    struct stat resultSb;
+    std::string tempPath = {};
+    int dst = -1;
+    bool result = false;
+    bool inPlace = false;
+    bool resultExists = false;
+    int src = open(localPath, O_RDONLY);
+    if (src < 0 || fstat(src, &localSb) != 0)
+    {
+        printf("failed to open %s\n", localPath);
+        goto cleanup;
+    }
+    // the result is often local itself (git), but the path doesn't have to be spelled the same way for that
+    // (./local, a symlink, a hard link), so it's the file that's compared, not the path
+    resultExists = stat(resultPath, &resultSb) == 0;
+    inPlace = resultExists && resultSb.st_dev == localSb.st_dev && resultSb.st_ino == localSb.st_ino;
+    if (inPlace)
+    {
+        dst = open(resultPath, O_WRONLY);
+    }
+    else
+    {
+        // never truncate resultPath: if it's local after all, that's the data we're copying from.
+        // The result is built next to it and renamed over it once it's complete
+        tempPath = std::string(resultPath) + ".binmerge-XXXXXX";
+        dst = mkstemp(tempPath.data());
+        if (dst >= 0)
+        {
+            // mkstemp makes it 0600, give it what the result had or what a new file would get
+            mode_t mask = umask(0);
+            umask(mask);
+            fchmod(dst, resultExists ? (resultSb.st_mode & 07777) : (0666 & ~mask));
+        }
+        else
+        {
+            tempPath.clear();
+        }
+    }
+    if (dst < 0)
+    {
+        printf("failed to open %s\n", resultPath);
+        goto cleanup;
+    }
+
+    if (!inPlace)
+    {
+        bool cloned = false;
+#ifdef FICLONE
+        // one syscall, and the result shares the local file's blocks until someone writes to them
+        cloned = ioctl(dst, FICLONE, src) == 0;
+#endif
+        if (!cloned)
+        {
+            // copy the gaps between the changed ranges, the changed ranges get written below anyway
+            const size_t sharedLen = std::min((size_t)localSb.st_size, mergedLen);
+            std::vector<ByteRange> gaps = {};
+            size_t offset = 0;
+            for (size_t i = 0; i <= changed.size() && offset < sharedLen; i++)
+            {
+                const size_t end = i < changed.size() ? std::min(changed[i].offset, sharedLen) : sharedLen;
+                if (end > offset)
+                {
+                    gaps.push_back({ offset, end - offset });
+                }
+                if (i < changed.size())
+                {
+                    offset = std::max(offset, changed[i].offset + changed[i].size);
+                }
+            }
+            // and of those, only the parts local actually stores. dst starts out empty, so local's holes stay holes
+            const std::vector<ByteRange> wholeFile = { { 0, sharedLen } };
+            const std::vector<ByteRange>& spans = localData ? *localData : wholeFile;
+            for (size_t g = 0, s = 0; g < gaps.size() && s < spans.size();)
+            {
+                const size_t gapEnd = gaps[g].offset + gaps[g].size;
+                const size_t spanEnd = spans[s].offset + spans[s].size;
+                const size_t start = std::max(gaps[g].offset, spans[s].offset);
+                const size_t end = std::min(gapEnd, spanEnd);
+                if (end > start && !CopyUnchangedSpan(src, dst, merged, start, end - start))
+                {
+                    printf("failed to write %s\n", resultPath);
+                    goto cleanup;
+                }
+                if (gapEnd < spanEnd)
+                {
+                    g++;
+                }
+                else
+                {
+                    s++;
+                }
+            }
+        }
+    }
+
+    for (const ByteRange& range : changed)
+    {
+        if (!WriteChangedRange(merged, range.offset, range.size,
+            [&](const char* data, size_t size, size_t offset) { return WriteAll(dst, data, size, offset); },
+            [&](size_t offset, size_t size) { return PunchHole(dst, offset, size); }))
+        {
+            printf("failed to write %s\n", resultPath);
+            goto cleanup;
+        }
+    }
+    // the clone (or local itself) may be longer than the merge result
+    if (ftruncate(dst, (off_t)mergedLen) != 0)
+    {
+        printf("failed to resize %s\n", resultPath);
+        goto cleanup;
+    }
+    result = true;
+
+cleanup:
+    if (src >= 0)
+    {
+        close(src);
+    }
+    if (dst >= 0)
+    {
+        result = (close(dst) == 0) && result;
+    }
+    if (!tempPath.empty())
+    {
+        if (result && rename(tempPath.c_str(), resultPath) != 0)
+        {
+            printf("failed to replace %s\n", resultPath);
+            result = false;
+        }
+        if (!result)
+        {
+            unlink(tempPath.c_str());
+        }
+    }
+    return result;
+}
+
+#else
+
+static bool WriteAt(HANDLE dst, const char* data, size_t size, size_t offset)
+{
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)offset;
+    if (!SetFilePointerEx(dst, position, nullptr, FILE_BEGIN))
+    {
+        return false;
+    }
+    while (size > 0)
+    {
+        DWORD written = 0;
+        DWORD chunk = (DWORD)std::min<size_t>(size, 1u << 30);
+        if (!WriteFile(dst, data, chunk, &written, nullptr) || written == 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// on a sparse file this deallocates the range. The file is only made sparse once we actually have something to punch
+static bool PunchHole(HANDLE dst, size_t offset, size_t size, bool& sparse)
+{
+    DWORD bytes = 0;
+    if (!sparse)
+    {
+        FILE_SET_SPARSE_BUFFER set = { TRUE };
+        sparse = DeviceIoControl(dst, FSCTL_SET_SPARSE, &set, sizeof(set), nullptr, 0, &bytes, nullptr) != 0;
+        if (!sparse)
+        {
+            return false;
+        }
+    }
+    FILE_ZERO_DATA_INFORMATION zero = {};
+    zero.FileOffset.QuadPart = (LONGLONG)offset;
+    zero.BeyondFinalZero.QuadPart = (LONGLONG)(offset + size);
+    return DeviceIoControl(dst, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), nullptr, 0, &bytes, nullptr) != 0;
+}
+
+// true if both paths name the same file, however they're spelled (volume serial + file index is the Windows inode)
+static bool IsSameFile(const char* a, const char* b)
+{
+    BY_HANDLE_FILE_INFORMATION info[2] = {};
+    const char* paths[2] = { a, b };
+    for (int i = 0; i < 2; i++)
+    {
+        HANDLE file = CreateFileA(paths[i], 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        bool ok = GetFileInformationByHandle(file, &info[i]) != 0;
+        CloseHandle(file);
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber
+        && info[0].nFileIndexHigh == info[1].nFileIndexHigh && info[0].nFileIndexLow == info[1].nFileIndexLow;
+}
+
+bool WriteMergedOutput(const char* localPath, const char* resultPath, const char* merged, size_t mergedLen, const std::vector<ByteRange>& changed,
+    const std::vector<ByteRange>* localData)
+{
+    // localData doesn't matter here, CopyFile keeps local's holes by itself
+    (void)localData;
+    // the result is often local itself, but the path doesn't have to be spelled the same way for that.
+    // Otherwise the result is built next to resultPath and moved over it once it's complete, so resultPath
+    // is never overwritten while it might still be what we're copying from
+    const bool inPlace = IsSameFile(localPath, resultPath);
+    const std::string tempPath = inPlace ? std::string() : std::string(resultPath) + ".binmerge-" + std::to_string(GetCurrentProcessId());
+    const char* writePath = inPlace ? resultPath : tempPath.c_str();
+    // CopyFile block clones on ReFS and dev drives, and copies without going through us everywhere else
+    if (!inPlace && !CopyFileA(localPath, writePath, FALSE))
+    {
+        printf("failed to copy %s to %s\n", localPath, writePath);
+        return false;
+    }
+    HANDLE dst = CreateFileA(writePath, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (dst == INVALID_HANDLE_VALUE)
+    {
+        printf("failed to open %s\n", writePath);
+        if (!inPlace)
+        {
+            DeleteFileA(writePath);
+        }
+        return false;
+    }
+    bool result = true;
+    bool sparse = false;
+    for (size_t i = 0; i < changed.size() && result; i++)
+    {
+        result = WriteChangedRange(merged, changed[i].offset, changed[i].size,
+            [&](const char* data, size_t size, size_t offset) { return WriteAt(dst, data, size, offset); },
+            [&](size_t offset, size_t size) { return PunchHole(dst, offset, size, sparse); });
+    }
+    if (result)
+    {
+        LARGE_INTEGER end;
+        end.QuadPart = (LONGLONG)mergedLen;
+        result = SetFilePointerEx(dst, end, nullptr, FILE_BEGIN) && SetEndOfFile(dst);
+    }
+    result = CloseHandle(dst) && result;
+    if (!inPlace)
+    {
+        result = result && MoveFileExA(writePath, resultPath, MOVEFILE_REPLACE_EXISTING);
+        if (!result)
+        {
+            DeleteFileA(writePath);
+        }
+    }
+    if (!result)
+    {
+        printf("failed to write %s\n", resultPath);
+    }
+    return result;
+}
+
+#endif
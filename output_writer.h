@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// writing the merge result.
+// The merged file is usually the local file with a handful of bytes changed, so instead of writing
+// the whole thing out we start from a copy of local that the kernel makes for us (a reflink clone
+// where the filesystem can do it, an in-kernel copy where it can't) and only write the parts that changed.
+struct ByteRange
+{
+    size_t offset = 0;
+    size_t size = 0;
+};
+
+// where merged differs from local, in whole blocks, sorted and coalesced.
+// Anything past the end of local counts as changed.
+// localData is where local actually has data (see sparse_file.h), nullptr if it's all data.
+// Local's holes are never read, a block there only counts as changed if merged isn't zero
+void FindChangedRanges(const char* local, size_t localLen, const char* merged, size_t mergedLen, std::vector<ByteRange>& changed,
+    const std::vector<ByteRange>* localData = nullptr);
+
+// writes merged to resultPath. localPath has to still hold the local file that changed was computed against.
+// If resultPath is the local file (git), however the path is spelled, the changed ranges are just written over it in place.
+// Otherwise the result is built in a temporary file next to resultPath and renamed over it, resultPath is never truncated.
+// Zero blocks in the changed ranges are punched out as holes where the filesystem supports it, and when local
+// has to be copied, only localData (nullptr = everything) is, so the result stays as sparse as local was.
+// Prints why and returns false if something failed
+bool WriteMergedOutput(const char* localPath, const char* resultPath, const char* merged, size_t mergedLen, const std::vector<ByteRange>& changed,
+    const std::vector<ByteRange>* localData = nullptr);
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// the one worker pool everything uses. Jobs are numbered and independent of each other, and every thread
+// just grabs the next unclaimed number until they run out: no queue, no locks, and a slow job only
+// holds up the thread that has it, not the ones that would have gotten the jobs after it.
+
+// threadCount 0 means use every hardware thread
+inline uint32_t ResolveThreadCount(uint32_t threadCount)
+{
+    return threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// how many threads ParallelFor actually runs for count jobs. There's never more threads than jobs
+inline uint32_t GetParallelWorkerCount(size_t count, uint32_t threadCount)
+{
+    return (uint32_t)std::min<size_t>(ResolveThreadCount(threadCount), std::max<size_t>(count, 1));
+}
+
+// runs fn(i) for every i in [0, count). If fn takes a second argument, it's called as fn(i, worker) with
+// worker in [0, GetParallelWorkerCount(count, threadCount)), for keeping scratch buffers per thread.
+// The calling thread is worker 0, so with one thread (or one job) nothing gets spawned
+template <typename Fn>
+void ParallelFor(size_t count, uint32_t threadCount, Fn&& fn)
+{
+    const uint32_t workerCount = GetParallelWorkerCount(count, threadCount);
+    std::atomic<size_t> next = 0;
+    auto worker = [&](uint32_t workerIndex)
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            if constexpr (std::is_invocable_v<Fn&, size_t, uint32_t>)
+            {
+                fn(i, workerIndex);
+            }
+            else
+            {
+                fn(i);
+            }
+        }
+    };
+    std::vector<std::thread> workers = {};
+    for (uint32_t i = 1; i < workerCount; i++)
+    {
+        workers.emplace_back(worker, i);
+    }
+    worker(0);
+    for (std::thread& t : workers)
+    {
+        t.join();
+    }
+}
@@ -1,6 +1,8 @@
 #ifndef _MAPPED_FILE_H
 #define _MAPPED_FILE_H
 
+#include <cstddef>
+
 
 // https://github.com/MolecularMatters/raw_pdb/blob/main/src/Examples/ExampleMemoryMappedFile.h
 
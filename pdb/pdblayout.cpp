@@ -0,0 +1,79 @@
+#include "pdblayout.h"
+#include <cstdio>
+
+namespace
+{
+    bool AddFields(const TypeDatabase& typeDatabase, const TypeDatabaseLayout& layout, bool isFile, PdbFormatLayout& out)
+    {
+        const std::vector<TypeDatabaseLayout>& layouts = typeDatabase.GetLayouts();
+        bool hasMagic = false;
+        for (const TypeDatabaseField& source : layout.fields)
+        {
+            const TypeDatabaseLayout* nested = source.type == STRUCTURE && source.layoutIndex != NO_TYPE_DATABASE_LAYOUT ?
+                &layouts[source.layoutIndex] : nullptr;
+            if (nested && nested->fields.empty())
+            {
+                continue;
+            }
+            if (isFile && source.offset < sizeof(uint32_t))
+            {
+                hasMagic = source.offset == 0 && source.size == sizeof(uint32_t) && source.bitWidth == 0;
+                if (!hasMagic)
+                {
+                    break;
+                }
+                continue;
+            }
+            if (source.size == 0)
+            {
+                printf("can't tell what %s::%s is, so %s can't be merged\n", layout.name.c_str(), source.name.c_str(), layout.name.c_str());
+                return false;
+            }
+            FieldData& field = out.fields.emplace_back();
+            field.size = source.size;
+            field.offset = source.offset;
+            field.type = source.type;
+            field.elementType = source.elementType;
+            field.elementCount = source.elementCount;
+            field.bitPosition = source.bitPosition;
+            field.bitWidth = source.bitWidth;
+            snprintf(field.name, sizeof(field.name), "%s", source.name.c_str());
+            if (nested)
+            {
+                std::unique_ptr<PdbFormatLayout> child = std::make_unique<PdbFormatLayout>();
+                if (!AddFields(typeDatabase, *nested, false, *child))
+                {
+                    return false;
+                }
+                field.data = reinterpret_cast<char*>(&child->layout);
+                out.children.push_back(std::move(child));
+            }
+        }
+        if (isFile && !hasMagic)
+        {
+            printf("%s doesn't start with a 4 byte magic, it isn't a file format\n", layout.name.c_str());
+            return false;
+        }
+        out.layout.fieldsCount = out.fields.size();
+        out.layout.fields = out.fields.data();
+        return true;
+    }
+}
+
+const TypeDatabaseLayout* FindLayoutByName(const TypeDatabase& typeDatabase, const char* name)
+{
+    for (const TypeDatabaseLayout& layout : typeDatabase.GetLayouts())
+    {
+        if (layout.name == name)
+        {
+            return &layout;
+        }
+    }
+    return nullptr;
+}
+
+bool BuildFormatLayout(const TypeDatabase& typeDatabase, const TypeDatabaseLayout& layout, PdbFormatLayout& out)
+{
+    out = {};
+    return AddFields(typeDatabase, layout, true, out);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "typedatabase.h"
+#include "../format_layout.h"
+#include <memory>
+#include <vector>
+
+// a layout from the type database as a binmerge FormatLayout, so files written straight from that structure
+// can be merged field by field. Nested UDTs become STRUCTURE fields that point at a child layout of their own.
+// FormatLayout only points at its fields and children, this owns them
+struct PdbFormatLayout
+{
+    FormatLayout layout = {};
+    std::vector<FieldData> fields;
+    std::vector<std::unique_ptr<PdbFormatLayout>> children; // what the STRUCTURE fields' data points at
+};
+
+// the first layout in the database with that name, nullptr if there isn't one
+const TypeDatabaseLayout* FindLayoutByName(const TypeDatabase& typeDatabase, const char* name);
+
+// the top level structure is a whole file, so it has to start with a 4 byte magic. That member isn't a field,
+// and layout.magic is left 0 for whoever knows what the files look like. Empty bases take no room and are skipped,
+// unions are one opaque value.
+// The database can grow (and move its layouts) with every pdb added, so this copies everything it needs.
+// Prints why and returns false if some member can't be described. The result isn't finalized (FinalizeLayout)
+bool BuildFormatLayout(const TypeDatabase& typeDatabase, const TypeDatabaseLayout& layout, PdbFormatLayout& out);
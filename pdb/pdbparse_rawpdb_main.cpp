@@ -9,8 +9,18 @@
 #include "PDB_NamesStream.h"
 
 #include "typetable.h"
+#include "typedatabase.h"
+#include "symbolindex.h"
+#include "pdblayout.h"
+#include "prefetch.h"
 
+#include "../sparse_file.h"
+#include "../three_way_merge.h"
 #include "mapped_file.h"
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
 #include <vector>
 
 #define MODULE_LOCAL_PATH_START "C:\\Dev"
@@ -324,7 +334,7 @@ void process_possible_data_symbol(
 void ProcessSymbols(
     const PDB::RawFile& rawPdbFile, 
     const PDB::DBIStream& dbiStream, 
-    const PDB::TPIStream& tpiStream)
+    const TypeTable& typeTable)
 {
     // needed for both public and global streams
     const PDB::CoalescedMSFStream symbolRecordStream = dbiStream.CreateSymbolRecordStream(rawPdbFile);
@@ -332,7 +342,14 @@ void ProcessSymbols(
 	const PDB::GlobalSymbolStream globalSymbolStream = dbiStream.CreateGlobalSymbolStream(rawPdbFile);
 	const PDB::ModuleInfoStream moduleInfoStream = dbiStream.CreateModuleInfoStream(rawPdbFile);
     const PDB::ImageSectionStream imageSectionStream = dbiStream.CreateImageSectionStream(rawPdbFile);
-    TypeTable typeTable(tpiStream);
+
+    // looks names up through the GSI hash buckets, so it doesn't scan the globals
+    SymbolNameIndex globalSymbolIndex;
+    globalSymbolIndex.Build(rawPdbFile, dbiStream, globalSymbolStream, symbolRecordStream);
+    if (const PDB::CodeView::DBI::Record* appState = globalSymbolIndex.Find("g_appstate"))
+    {
+        printf("found g_appstate (symbol kind %i)\n", static_cast<int>(appState->header.kind));
+    }
 
     //public_symbols_stream(publicSymbolStream, symbolRecordStream, imageSectionStream);
     //global_symbols_stream(globalSymbolStream, symbolRecordStream, imageSectionStream);
@@ -356,14 +373,15 @@ void ProcessSymbols(
     }
 }
 
-int main()
+// called as soon as a pdb's types are in the type database, before the (slow) symbol processing
+using TypesReadyCallback = std::function<void(const TypeDatabase& typeDatabase)>;
+
+// pdbFile is the mapped pdb, the caller opens and closes it
+static int ProcessPdb(const char* pdbPath, const MemoryMappedFile::Handle& pdbFile, TypeDatabase& typeDatabase, const TypesReadyCallback& onTypesReady = {})
 {
-    // open memmapped pdb file
-    const char* pdbPath = "Axe64Lib.pdb";
-    MemoryMappedFile::Handle pdbFile = MemoryMappedFile::Open(pdbPath);
     void* pdbFileData = pdbFile.baseAddress;
     // make sure it's well-formed
-    if (PDB::ValidateFile(pdbFileData, pdbFile.len) != PDB::ErrorCode::Success)
+    if (!pdbFileData || PDB::ValidateFile(pdbFileData, pdbFile.len) != PDB::ErrorCode::Success)
     {
         return 1;
     }
@@ -371,17 +389,34 @@ int main()
     const PDB::RawFile rawPdbFile = PDB::CreateRawFile(pdbFile.baseAddress);
     if (PDB::HasValidDBIStream(rawPdbFile) != PDB::ErrorCode::Success)
 	{
-		MemoryMappedFile::Close(pdbFile);
 		return 2;
 	}
+    // info about types used in the program
+	if (PDB::HasValidTPIStream(rawPdbFile) != PDB::ErrorCode::Success)
+	{
+	    return 5;
+	}
+	const PDB::TPIStream tpiStream = PDB::CreateTPIStream(rawPdbFile);
+    // building the type table is by far the most expensive part of startup, and it only needs the TPI stream.
+    // Kick it off now and do the rest of the validation while it runs
+    std::future<std::unique_ptr<TypeTable>> typeTableTask = std::async(std::launch::async, [&rawPdbFile, &tpiStream]()
+    {
+        return std::make_unique<TypeTable>(rawPdbFile, tpiStream);
+    });
+    // the type table is reading from the mapped pdb, so it has to be done before the caller unmaps
+    auto fail = [&typeTableTask](int errorCode)
+    {
+        typeTableTask.wait();
+        return errorCode;
+    };
+
     // sets up offsets for info stream (we just use this here for fastlink validation)
 	const PDB::InfoStream infoStream(rawPdbFile);
     // more validation
 	if (infoStream.UsesDebugFastLink())
 	{
 		// PDB was linked using unsupported option /DEBUG:FASTLINK
-		MemoryMappedFile::Close(pdbFile);
-		return 3;
+		return fail(3);
 	}
     // infostream also gets us a lot of info about the pdb itself
     const auto h = infoStream.GetHeader();
@@ -395,22 +430,181 @@ int main()
     const PDB::DBIStream dbiStream = PDB::CreateDBIStream(rawPdbFile);
 	if (!HasValidDBIStreams(rawPdbFile, dbiStream))
 	{
-		MemoryMappedFile::Close(pdbFile);
-		return 4;
-	}
-    // info about types used in the program
-	const PDB::TPIStream tpiStream = PDB::CreateTPIStream(rawPdbFile);
-	if (PDB::HasValidTPIStream(rawPdbFile) != PDB::ErrorCode::Success)
-	{
-		MemoryMappedFile::Close(pdbFile);
-	    return 5;
+		return fail(4);
 	}
-    ProcessSymbols(rawPdbFile, dbiStream, tpiStream);
-	MemoryMappedFile::Close(pdbFile);
+
+    const std::unique_ptr<TypeTable> typeTable = typeTableTask.get();
+    const size_t layoutsBefore = typeDatabase.GetLayouts().size();
+    const size_t referencesBefore = typeDatabase.GetReferenceCount();
+    typeDatabase.AddTypes(pdbPath, *typeTable);
+    printf("%s: %zu UDTs, %zu of them new layouts\n", pdbPath,
+        typeDatabase.GetReferenceCount() - referencesBefore, typeDatabase.GetLayouts().size() - layoutsBefore);
+    if (onTypesReady)
+    {
+        onTypesReady(typeDatabase);
+    }
+
+    ProcessSymbols(rawPdbFile, dbiStream, *typeTable);
+    return 0;
+}
+
+// binmerge's merge driver (RunMergeDriver), with the layout from the pdbs instead of the format registry.
+// Runs on its own thread while the rest of the pdbs are processed. The inputs have been prefetching since startup,
+// paths are base, local and remote.
+// Exit codes are the driver's: 0 = merged cleanly, 1 = conflicts, 2 = couldn't merge at all
+static int MergeWithPdbLayout(std::unique_ptr<PdbFormatLayout> layout, FilePrefetcher& inputs, const char* const* paths, const char* resultPath)
+{
+    MemoryMappedFile::Handle files[3] = {};
+    const char* data[3] = {};
+    size_t lens[3] = {};
+    bool opened = true;
+    for (int i = 0; i < 3; i++)
+    {
+        files[i] = inputs.Wait(i);
+        data[i] = (const char*)files[i].baseAddress;
+        lens[i] = files[i].len;
+        if (!data[i])
+        {
+            printf("failed to open %s\n", paths[i]);
+            opened = false;
+        }
+    }
+    // the layout knows where the magic is, the base says what it is
+    uint32_t magics[3] = {};
+    for (int i = 0; i < 3 && opened; i++)
+    {
+        opened = lens[i] >= sizeof(magics[i]);
+        if (opened)
+        {
+            memcpy(&magics[i], data[i], sizeof(magics[i]));
+            opened = magics[i] == magics[0];
+        }
+        if (!opened)
+        {
+            printf("%s isn't the same format as %s\n", paths[i], paths[0]);
+        }
+    }
+    layout->layout.magic = magics[0];
+    FinalizeLayout(&layout->layout);
+
+    // sparse inputs: whatever is a hole in all three never gets read
+    std::vector<ByteRange> fileData[3] = {};
+    std::vector<ByteRange> dataRanges = {};
+    for (int i = 0; i < 3 && opened; i++)
+    {
+        FindDataRanges(files[i], fileData[i]);
+    }
+    UniteDataRanges(fileData, 3, dataRanges);
+
+    std::vector<char> merged = {};
+    bool conflicts = false;
+    const bool canMerge = opened && MergeFiles(layout->layout, data[0], lens[0], data[1], lens[1], data[2], lens[2], merged, &conflicts, &dataRanges);
+    std::vector<ByteRange> changed = {};
+    if (canMerge)
+    {
+        FindChangedRanges(data[1], lens[1], merged.data(), merged.size(), changed, &fileData[1]);
+    }
+    // the result is often one of the inputs, so unmap everything before writing
+    for (int i = 0; i < 3; i++)
+    {
+        inputs.Close(i);
+    }
+    if (!canMerge || !WriteMergedOutput(paths[1], resultPath, merged.data(), merged.size(), changed, &fileData[1]))
+    {
+        return 2;
+    }
+    return conflicts ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // pdbparse [pdb...] [--merge <type> <base> <local> <remote> <result>]
+    // every pdb on the command line goes into the same type database,
+    // so layouts shared between them (or between builds of the same one) are only stored once.
+    // --merge merges three files written straight from the struct <type> (as defined in the first pdb that has it),
+    // the same way binmerge's merge driver does
+    int pdbArgCount = argc - 1;
+    const char* const* mergeArgs = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--merge") == 0)
+        {
+            if (argc - i - 1 != 5)
+            {
+                printf("usage: pdbparse [pdb...] [--merge <type> <base> <local> <remote> <result>]\n");
+                return 2;
+            }
+            mergeArgs = argv + i + 1;
+            pdbArgCount = i - 1;
+            break;
+        }
+    }
+    static const char* defaultPdbPaths[] = { "Axe64Lib.pdb" };
+    const char* const* pdbPaths = pdbArgCount > 0 ? argv + 1 : defaultPdbPaths;
+    const int pdbCount = pdbArgCount > 0 ? pdbArgCount : 1;
+
+    // nothing below waits on a read it could have started earlier: the merge inputs are read in from the start,
+    // and each pdb while the one before it is parsed
+    FilePrefetcher mergeInputs;
+    if (mergeArgs)
+    {
+        mergeInputs.Start(mergeArgs + 1, 3);
+    }
+    FilePrefetcher pdbFiles;
+    pdbFiles.Start(pdbPaths, 1);
+
+    TypeDatabase typeDatabase;
+    // the merge starts as soon as the type is in the database, and runs alongside the symbol processing
+    // of that pdb and any after it. Declared after everything it uses, so it's joined first on the way out
+    std::future<int> mergeTask;
+    int mergeResult = 0;
+    bool foundMergeType = false;
+    auto startMerge = [&](const TypeDatabase& database)
+    {
+        const TypeDatabaseLayout* found = foundMergeType ? nullptr : FindLayoutByName(database, mergeArgs[0]);
+        if (!found)
+        {
+            return;
+        }
+        foundMergeType = true;
+        // built here and not on the merge thread, the next pdb can move the database's layouts around
+        std::unique_ptr<PdbFormatLayout> layout = std::make_unique<PdbFormatLayout>();
+        if (!BuildFormatLayout(database, *found, *layout))
+        {
+            mergeResult = 2;
+            return;
+        }
+        mergeTask = std::async(std::launch::async, MergeWithPdbLayout, std::move(layout), std::ref(mergeInputs), mergeArgs + 1, mergeArgs[4]);
+    };
+    for (int i = 0; i < pdbCount; i++)
+    {
+        if (i + 1 < pdbCount)
+        {
+            pdbFiles.Start(pdbPaths + i + 1, 1);
+        }
+        const int result = ProcessPdb(pdbPaths[i], pdbFiles.Wait(i), typeDatabase, mergeArgs ? TypesReadyCallback(startMerge) : TypesReadyCallback());
+        pdbFiles.Close(i);
+        if (result != 0)
+        {
+            printf("failed to process %s (%i)\n", pdbPaths[i], result);
+            return result;
+        }
+    }
+    printf("%zu distinct layouts across %zu pdbs (%zu UDTs total)\n",
+        typeDatabase.GetLayouts().size(), typeDatabase.GetPdbNames().size(), typeDatabase.GetReferenceCount());
+    if (mergeArgs && !foundMergeType)
+    {
+        printf("none of the pdbs define %s, nothing to merge\n", mergeArgs[0]);
+        mergeResult = 2;
+    }
+    if (mergeTask.valid())
+    {
+        mergeResult = mergeTask.get();
+    }
     #ifdef _WIN32
     //system("pause");
     #endif
-    return 0;
+    return mergeResult;
 }
 
 
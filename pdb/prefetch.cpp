@@ -0,0 +1,79 @@
+#include "prefetch.h"
+
+#include <string>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace
+{
+    MemoryMappedFile::Handle OpenAndPrefetch(const std::string& path)
+    {
+        MemoryMappedFile::Handle file = MemoryMappedFile::Open(path.c_str());
+        if (!file.baseAddress || file.len == 0)
+        {
+            return file;
+        }
+        // ask the OS to start reading everything in...
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range = { file.baseAddress, file.len };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        const size_t pageSize = 4096;
+#else
+        madvise(file.baseAddress, file.len, MADV_WILLNEED);
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        // ...and then fault every page in on this thread, so whoever uses the file later never blocks on I/O
+        const volatile char* bytes = static_cast<const volatile char*>(file.baseAddress);
+        char sink = 0;
+        for (size_t offset = 0; offset < file.len; offset += pageSize)
+        {
+            sink ^= bytes[offset];
+        }
+        (void)sink;
+        return file;
+    }
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+    for (size_t i = 0; i < m_pending.size(); i++)
+    {
+        Close(i);
+    }
+}
+
+void FilePrefetcher::Start(const char* const* paths, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        // copy the path, the caller's string doesn't have to outlive the reader
+        m_pending.push_back(std::async(std::launch::async, OpenAndPrefetch, std::string(paths[i])));
+        m_files.push_back({});
+        m_ready.push_back(false);
+    }
+}
+
+const MemoryMappedFile::Handle& FilePrefetcher::Wait(size_t index)
+{
+    if (!m_ready[index])
+    {
+        m_files[index] = m_pending[index].get();
+        m_ready[index] = true;
+    }
+    return m_files[index];
+}
+
+void FilePrefetcher::Close(size_t index)
+{
+    Wait(index);
+    if (m_files[index].baseAddress)
+    {
+        MemoryMappedFile::Close(m_files[index]);
+        m_files[index].baseAddress = nullptr;
+    }
+}
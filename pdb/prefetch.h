@@ -0,0 +1,36 @@
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+#include "mapped_file.h"
+#include <future>
+#include <vector>
+
+// maps files and pulls their pages into memory on background reader threads,
+// so the I/O overlaps with whatever we're doing in the meantime (parsing the pdb).
+// On a cold cache that's most of the cost of opening a file.
+// Start can be called again later to queue more files, indices keep counting up
+class FilePrefetcher
+{
+public:
+    FilePrefetcher() = default;
+    ~FilePrefetcher();
+
+    // returns right away. Each file gets its own reader, they're I/O bound so they don't fight over cores
+    void Start(const char* const* paths, size_t count);
+
+    // blocks until file i is mapped and resident. baseAddress is nullptr if it couldn't be opened.
+    // The prefetcher keeps ownership, files are closed when it goes away (or with Close)
+    const MemoryMappedFile::Handle& Wait(size_t index);
+    // unmaps file i early, once nobody needs it anymore. Waits for its reader first
+    void Close(size_t index);
+
+    FilePrefetcher(const FilePrefetcher&) = delete;
+    FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+
+private:
+    std::vector<std::future<MemoryMappedFile::Handle>> m_pending;
+    std::vector<MemoryMappedFile::Handle> m_files;
+    std::vector<bool> m_ready;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include "symbolindex.h"
+#include <cstring>
+
+namespace
+{
+    // GSI hash stream layout, see GSIHashHdr in microsoft-pdb's gsi.h
+    struct GsiHashHeader
+    {
+        uint32_t signature;
+        uint32_t version;
+        uint32_t hashRecordBytes;
+        uint32_t bucketBytes; // bitmap + compressed bucket offsets
+    };
+    constexpr uint32_t GSI_SIGNATURE = 0xffffffffu;
+    constexpr uint32_t GSI_VERSION = 0xeffe0000u + 19990810u;
+    constexpr uint32_t GSI_BUCKET_COUNT = 4096;
+    // one bit per bucket plus one, rounded up to whole 32 bit words
+    constexpr uint32_t GSI_BITMAP_WORDS = (GSI_BUCKET_COUNT + 1 + 31) / 32;
+    // bucket offsets are in units of the in-memory hash record the linker had (pointer + cref + pad on 32 bit)
+    constexpr uint32_t GSI_HASH_RECORD_IN_MEMORY_SIZE = 12;
+    constexpr uint16_t NO_STREAM = 0xffff;
+
+    // the linker's bucket hash (LHashPbCb in microsoft-pdb), case insensitive-ish so a bucket can hold other names
+    uint32_t HashStringV1(const char* name)
+    {
+        const size_t length = strlen(name);
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(name);
+        uint32_t hash = 0;
+        size_t i = 0;
+        for (; i + 4 <= length; i += 4)
+        {
+            hash ^= uint32_t(bytes[i]) | uint32_t(bytes[i + 1]) << 8 | uint32_t(bytes[i + 2]) << 16 | uint32_t(bytes[i + 3]) << 24;
+        }
+        if (i + 2 <= length)
+        {
+            hash ^= uint32_t(bytes[i]) | uint32_t(bytes[i + 1]) << 8;
+            i += 2;
+        }
+        if (i < length)
+        {
+            hash ^= bytes[i];
+        }
+        hash |= 0x20202020u;
+        hash ^= hash >> 11;
+        return hash ^ (hash >> 16);
+    }
+
+    uint32_t HashName(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *name; name++)
+        {
+            hash ^= static_cast<uint8_t>(*name);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    // the symbols we'd want to look up by name: data (where assets live) and UDTs (their types)
+    const char* GetIndexableName(const PDB::CodeView::DBI::Record* record)
+    {
+        using SRK = PDB::CodeView::DBI::SymbolRecordKind;
+        switch (record->header.kind)
+        {
+            case SRK::S_GDATA32: return record->data.S_GDATA32.name;
+            case SRK::S_LDATA32: return record->data.S_LDATA32.name;
+            case SRK::S_GTHREAD32: return record->data.S_GTHREAD32.name;
+            case SRK::S_LTHREAD32: return record->data.S_LTHREAD32.name;
+            case SRK::S_UDT: return record->data.S_UDT.name;
+            case SRK::S_UDT_ST: return record->data.S_UDT_ST.name;
+            default: return nullptr;
+        }
+    }
+}
+
+void SymbolNameIndex::Build(const PDB::RawFile& rawPdbFile, const PDB::DBIStream& dbiStream,
+    const PDB::GlobalSymbolStream& globalSymbolStream, const PDB::CoalescedMSFStream& symbolRecordStream)
+{
+    m_globalSymbolStream = &globalSymbolStream;
+    m_symbolRecordStream = &symbolRecordStream;
+    m_bucketStarts.clear();
+    m_slots.clear();
+    m_names.clear();
+    m_records.clear();
+    if (!ReadGsiBuckets(rawPdbFile, dbiStream))
+    {
+        BuildFromAllRecords();
+    }
+}
+
+bool SymbolNameIndex::ReadGsiBuckets(const PDB::RawFile& rawPdbFile, const PDB::DBIStream& dbiStream)
+{
+    const uint16_t streamIndex = dbiStream.GetHeader().globalStreamIndex;
+    if (streamIndex == NO_STREAM)
+    {
+        return false;
+    }
+    const PDB::DirectMSFStream stream = rawPdbFile.CreateMSFStream<PDB::DirectMSFStream>(streamIndex);
+    if (stream.GetSize() < sizeof(GsiHashHeader))
+    {
+        return false;
+    }
+    const GsiHashHeader header = stream.ReadAtOffset<GsiHashHeader>(0);
+    const size_t recordCount = m_globalSymbolStream->GetRecords().GetLength();
+    const size_t bucketsOffset = sizeof(GsiHashHeader) + size_t(header.hashRecordBytes);
+    if (header.signature != GSI_SIGNATURE || header.version != GSI_VERSION
+        || header.hashRecordBytes / sizeof(PDB::HashRecord) != recordCount
+        || header.bucketBytes < GSI_BITMAP_WORDS * sizeof(uint32_t)
+        || bucketsOffset + header.bucketBytes > stream.GetSize())
+    {
+        return false;
+    }
+
+    uint32_t bitmap[GSI_BITMAP_WORDS];
+    stream.ReadAtOffset(bitmap, sizeof(bitmap), bucketsOffset);
+    const size_t offsetCount = (header.bucketBytes - sizeof(bitmap)) / sizeof(uint32_t);
+    std::vector<uint32_t> offsets(offsetCount);
+    stream.ReadAtOffset(offsets.data(), offsetCount * sizeof(uint32_t), bucketsOffset + sizeof(bitmap));
+
+    // the offsets are only stored for the buckets that have something in them, in bucket order.
+    // An empty bucket starts (and ends) where the next non-empty one starts
+    m_bucketStarts.assign(GSI_BUCKET_COUNT + 1, UINT32_MAX);
+    m_bucketStarts[GSI_BUCKET_COUNT] = static_cast<uint32_t>(recordCount);
+    size_t used = 0;
+    for (uint32_t bucket = 0; bucket < GSI_BUCKET_COUNT; bucket++)
+    {
+        if (bitmap[bucket / 32] & (1u << (bucket % 32)))
+        {
+            if (used == offsetCount)
+            {
+                m_bucketStarts.clear();
+                return false;
+            }
+            m_bucketStarts[bucket] = offsets[used++] / GSI_HASH_RECORD_IN_MEMORY_SIZE;
+        }
+    }
+    for (uint32_t bucket = GSI_BUCKET_COUNT; bucket-- > 0;)
+    {
+        if (m_bucketStarts[bucket] == UINT32_MAX)
+        {
+            m_bucketStarts[bucket] = m_bucketStarts[bucket + 1];
+        }
+        else if (m_bucketStarts[bucket] > m_bucketStarts[bucket + 1])
+        {
+            m_bucketStarts.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void SymbolNameIndex::BuildFromAllRecords(void)
+{
+    const PDB::ArrayView<PDB::HashRecord> hashRecords = m_globalSymbolStream->GetRecords();
+    m_names.reserve(hashRecords.GetLength());
+    m_records.reserve(hashRecords.GetLength());
+
+    size_t capacity = 16;
+    while (capacity < hashRecords.GetLength() * 2)
+    {
+        capacity *= 2;
+    }
+    m_slots.assign(capacity, {});
+    const size_t mask = capacity - 1;
+
+    for (const PDB::HashRecord& hashRecord : hashRecords)
+    {
+        const PDB::CodeView::DBI::Record* record = m_globalSymbolStream->GetRecord(*m_symbolRecordStream, hashRecord);
+        const char* name = GetIndexableName(record);
+        if (!name)
+        {
+            continue;
+        }
+        const uint32_t hash = HashName(name);
+        for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+        {
+            Slot& s = m_slots[slot];
+            if (s.entry == UINT32_MAX)
+            {
+                s.hash = hash;
+                s.entry = static_cast<uint32_t>(m_names.size());
+                m_names.push_back(name);
+                m_records.push_back(record);
+                break;
+            }
+            if (s.hash == hash && strcmp(m_names[s.entry], name) == 0)
+            {
+                break; // first one wins
+            }
+        }
+    }
+}
+
+const PDB::CodeView::DBI::Record* SymbolNameIndex::Find(const char* name) const
+{
+    if (!m_bucketStarts.empty())
+    {
+        const PDB::ArrayView<PDB::HashRecord> hashRecords = m_globalSymbolStream->GetRecords();
+        const uint32_t bucket = HashStringV1(name) % GSI_BUCKET_COUNT;
+        for (uint32_t i = m_bucketStarts[bucket]; i < m_bucketStarts[bucket + 1]; i++)
+        {
+            const PDB::CodeView::DBI::Record* record = m_globalSymbolStream->GetRecord(*m_symbolRecordStream, hashRecords[i]);
+            const char* recordName = GetIndexableName(record);
+            if (recordName && strcmp(recordName, name) == 0)
+            {
+                return record;
+            }
+        }
+        return nullptr;
+    }
+
+    if (m_slots.empty())
+    {
+        return nullptr;
+    }
+    const size_t mask = m_slots.size() - 1;
+    const uint32_t hash = HashName(name);
+    // the table is never more than half full, so there's always an empty slot to stop at
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        const Slot& s = m_slots[slot];
+        if (s.entry == UINT32_MAX)
+        {
+            return nullptr;
+        }
+        if (s.hash == hash && strcmp(m_names[s.entry], name) == 0)
+        {
+            return m_records[s.entry];
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "PDB_DBIStream.h"
+#include "PDB_RawFile.h"
+#include <vector>
+
+// name -> symbol record lookup. The global symbol stream is just a big list of records,
+// so finding one symbol by name (like the asset root) by walking them means touching all of them.
+// The linker already wrote a hash table for it though (the GSI buckets at the end of the global stream),
+// so we only read the bucket offsets and a lookup just walks the few records of one bucket.
+// If the buckets are missing or look broken, we fall back to walking everything once into our own table.
+class SymbolNameIndex
+{
+public:
+    // the streams have to outlive the index, Find resolves records through them.
+    // If a name shows up more than once (statics with the same name in different TUs), the first one wins
+    void Build(const PDB::RawFile& rawPdbFile, const PDB::DBIStream& dbiStream,
+        const PDB::GlobalSymbolStream& globalSymbolStream, const PDB::CoalescedMSFStream& symbolRecordStream);
+
+    // nullptr if there's no data or UDT symbol with exactly that name
+    const PDB::CodeView::DBI::Record* Find(const char* name) const;
+
+    // false if we had to walk the whole stream because the GSI buckets weren't usable
+    inline bool IsUsingGsiBuckets(void) const { return !m_bucketStarts.empty(); }
+
+private:
+    bool ReadGsiBuckets(const PDB::RawFile& rawPdbFile, const PDB::DBIStream& dbiStream);
+    void BuildFromAllRecords(void);
+
+    const PDB::GlobalSymbolStream* m_globalSymbolStream = nullptr;
+    const PDB::CoalescedMSFStream* m_symbolRecordStream = nullptr;
+
+    // GSI buckets: hash records [m_bucketStarts[b], m_bucketStarts[b + 1]) all hash to bucket b
+    std::vector<uint32_t> m_bucketStarts;
+
+    // fallback, open addressing over every indexable record
+    struct Slot
+    {
+        uint32_t hash = 0;
+        uint32_t entry = UINT32_MAX; // index into m_names/m_records, UINT32_MAX means empty
+    };
+    std::vector<Slot> m_slots; // power of two sized, kept at most half full
+    std::vector<const char*> m_names;
+    std::vector<const PDB::CodeView::DBI::Record*> m_records;
+};
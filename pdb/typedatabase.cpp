@@ -0,0 +1,730 @@
+#include "typedatabase.h"
+#include <cstring>
+#include <unordered_set>
+
+namespace
+{
+    // leaf kinds from the CodeView spec (cvinfo.h). The records are read byte by byte below
+    // (they're mostly variable length anyway), so all we need from raw_pdb is the record pointers.
+    namespace Leaf
+    {
+        constexpr uint16_t MODIFIER = 0x1001;
+        constexpr uint16_t POINTER = 0x1002;
+        constexpr uint16_t FIELDLIST = 0x1203;
+        constexpr uint16_t BITFIELD = 0x1205;
+        constexpr uint16_t BCLASS = 0x1400;
+        constexpr uint16_t VBCLASS = 0x1401;
+        constexpr uint16_t IVBCLASS = 0x1402;
+        constexpr uint16_t INDEX = 0x1404;
+        constexpr uint16_t VFUNCTAB = 0x1409;
+        constexpr uint16_t ENUMERATE = 0x1502;
+        constexpr uint16_t ARRAY = 0x1503;
+        constexpr uint16_t CLASS = 0x1504;
+        constexpr uint16_t STRUCTURE = 0x1505;
+        constexpr uint16_t UNION = 0x1506;
+        constexpr uint16_t ENUM = 0x1507;
+        constexpr uint16_t MEMBER = 0x150d;
+        constexpr uint16_t STMEMBER = 0x150e;
+        constexpr uint16_t METHOD = 0x150f;
+        constexpr uint16_t NESTTYPE = 0x1510;
+        constexpr uint16_t ONEMETHOD = 0x1511;
+        constexpr uint16_t INTERFACE = 0x1519;
+        // newer compilers: same thing, with a 32 bit property field (and the member count moved after the type indices)
+        constexpr uint16_t CLASS2 = 0x1608;
+        constexpr uint16_t STRUCTURE2 = 0x1609;
+        constexpr uint16_t UNION2 = 0x160a;
+        constexpr uint16_t INTERFACE2 = 0x160b;
+
+        // numeric leaves: values < 0x8000 are stored inline, otherwise this says what follows
+        constexpr uint16_t NUMERIC = 0x8000;
+        constexpr uint16_t CHAR = 0x8000;
+        constexpr uint16_t SHORT = 0x8001;
+        constexpr uint16_t USHORT = 0x8002;
+        constexpr uint16_t LONG = 0x8003;
+        constexpr uint16_t ULONG = 0x8004;
+        constexpr uint16_t QUADWORD = 0x8009;
+        constexpr uint16_t UQUADWORD = 0x800a;
+
+        constexpr uint16_t PROPERTY_FWDREF = 0x80;
+        // the decorated name follows the name. Anonymous and function-local types all share names like <unnamed-tag>,
+        // this is what tells them apart
+        constexpr uint16_t PROPERTY_HASUNIQUENAME = 0x200;
+    }
+
+    // bounds-checked cursor over a single type record. Reading past the end
+    // doesn't crash, it just flips ok to false and hands back zeroes.
+    struct LeafReader
+    {
+        const uint8_t* cursor;
+        const uint8_t* end;
+        bool ok = true;
+
+        explicit LeafReader(const PDB::CodeView::TPI::Record* record)
+        {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(record);
+            uint16_t size;
+            memcpy(&size, bytes, sizeof(size));
+            // the size doesn't include itself, and we skip past the size and kind
+            cursor = bytes + 4;
+            end = bytes + sizeof(size) + size;
+        }
+        bool Take(void* out, size_t size)
+        {
+            if (!ok || (size_t)(end - cursor) < size)
+            {
+                ok = false;
+                memset(out, 0, size);
+                return false;
+            }
+            memcpy(out, cursor, size);
+            cursor += size;
+            return true;
+        }
+        uint8_t U8() { uint8_t v; Take(&v, sizeof(v)); return v; }
+        uint16_t U16() { uint16_t v; Take(&v, sizeof(v)); return v; }
+        uint32_t U32() { uint32_t v; Take(&v, sizeof(v)); return v; }
+        uint64_t Numeric()
+        {
+            const uint16_t leaf = U16();
+            if (leaf < Leaf::NUMERIC)
+            {
+                return leaf;
+            }
+            switch (leaf)
+            {
+                case Leaf::CHAR: return (uint64_t)(int64_t)(int8_t)U8();
+                case Leaf::SHORT: return (uint64_t)(int64_t)(int16_t)U16();
+                case Leaf::USHORT: return U16();
+                case Leaf::LONG: return (uint64_t)(int64_t)(int32_t)U32();
+                case Leaf::ULONG: return U32();
+                case Leaf::QUADWORD:
+                case Leaf::UQUADWORD: { uint64_t v; Take(&v, sizeof(v)); return v; }
+                default: ok = false; return 0; // reals, varstrings etc. never show up as offsets/sizes
+            }
+        }
+        const char* String()
+        {
+            const char* result = reinterpret_cast<const char*>(cursor);
+            const void* terminator = ok ? memchr(cursor, 0, end - cursor) : nullptr;
+            if (!terminator)
+            {
+                ok = false;
+                return "";
+            }
+            cursor = static_cast<const uint8_t*>(terminator) + 1;
+            return result;
+        }
+        void SkipPadding()
+        {
+            // LF_PAD1..LF_PAD15, the low nibble says how many bytes to skip to the next entry
+            if (ok && cursor < end && *cursor > 0xF0)
+            {
+                cursor += *cursor & 0x0F;
+            }
+        }
+        bool AtEnd() const { return !ok || cursor >= end; }
+    };
+
+    uint64_t Fnv1a(uint64_t hash, const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+    template <typename T>
+    uint64_t Fnv1a(uint64_t hash, const T& value)
+    {
+        return Fnv1a(hash, &value, sizeof(value));
+    }
+    uint64_t Fnv1a(uint64_t hash, const char* str)
+    {
+        return Fnv1a(hash, str, strlen(str) + 1);
+    }
+    constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+
+    uint16_t GetKind(const PDB::CodeView::TPI::Record* record)
+    {
+        return static_cast<uint16_t>(record->header.kind);
+    }
+    bool IsUdtKind(uint16_t kind)
+    {
+        return kind == Leaf::CLASS || kind == Leaf::STRUCTURE || kind == Leaf::INTERFACE || kind == Leaf::UNION ||
+            kind == Leaf::CLASS2 || kind == Leaf::STRUCTURE2 || kind == Leaf::INTERFACE2 || kind == Leaf::UNION2;
+    }
+
+    struct UdtHeader
+    {
+        uint32_t property = 0;
+        uint32_t fieldList = 0;
+        uint64_t size = 0;
+        const char* name = "";
+        const char* uniqueName = ""; // empty unless PROPERTY_HASUNIQUENAME
+    };
+    bool ReadUdtHeader(const PDB::CodeView::TPI::Record* record, UdtHeader& header)
+    {
+        LeafReader reader(record);
+        const uint16_t kind = GetKind(record);
+        const bool isUnion = kind == Leaf::UNION || kind == Leaf::UNION2;
+        if (kind >= Leaf::CLASS2)
+        {
+            header.property = reader.U32();
+            header.fieldList = reader.U32();
+            if (!isUnion)
+            {
+                reader.U32(); // derived list
+                reader.U32(); // vtable shape
+            }
+            reader.U16(); // member count
+        }
+        else
+        {
+            reader.U16(); // member count
+            header.property = reader.U16();
+            header.fieldList = reader.U32();
+            if (!isUnion)
+            {
+                reader.U32(); // derived list
+                reader.U32(); // vtable shape
+            }
+        }
+        header.size = reader.Numeric();
+        header.name = reader.String();
+        if (header.property & Leaf::PROPERTY_HASUNIQUENAME)
+        {
+            header.uniqueName = reader.String();
+        }
+        return reader.ok;
+    }
+    // what a forward declaration and its definition have in common: the unique name if there is one
+    const char* GetDefinitionKey(const UdtHeader& header)
+    {
+        return *header.uniqueName ? header.uniqueName : header.name;
+    }
+
+    // a description of a type that means the same thing in every PDB (type indices don't).
+    // resolve(typeIndex) gives the database layout of a UDT, so nested UDTs can be described by their structure
+    template <typename Resolve>
+    uint64_t HashFieldType(const TypeTable& typeTable, uint32_t typeIndex, const std::vector<TypeDatabaseLayout>& layouts, Resolve&& resolve)
+    {
+        const PDB::CodeView::TPI::Record* record = typeTable.GetTypeRecord(typeIndex);
+        if (typeIndex < typeTable.GetFirstTypeIndex() || !record)
+        {
+            // primitive types (int, float, T_64PVOID, ...) have fixed, well known indices
+            return Fnv1a(FNV_OFFSET, typeIndex);
+        }
+        const uint16_t kind = GetKind(record);
+        uint64_t hash = Fnv1a(FNV_OFFSET, kind);
+        LeafReader reader(record);
+        switch (kind)
+        {
+            case Leaf::MODIFIER:
+            {
+                // const/volatile don't change the layout
+                return HashFieldType(typeTable, reader.U32(), layouts, resolve);
+            }
+            case Leaf::POINTER:
+            {
+                reader.U32(); // pointee. Where a pointer points doesn't matter for the bytes in a file
+                const uint32_t attributes = reader.U32();
+                return Fnv1a(hash, (attributes >> 13) & 0x3F); // size of the pointer
+            }
+            case Leaf::ARRAY:
+            {
+                const uint32_t elementType = reader.U32();
+                reader.U32(); // index type
+                hash = Fnv1a(hash, HashFieldType(typeTable, elementType, layouts, resolve));
+                return Fnv1a(hash, reader.Numeric());
+            }
+            case Leaf::BITFIELD:
+            {
+                const uint32_t baseType = reader.U32();
+                hash = Fnv1a(hash, HashFieldType(typeTable, baseType, layouts, resolve));
+                hash = Fnv1a(hash, reader.U8()); // length
+                return Fnv1a(hash, reader.U8()); // position
+            }
+            case Leaf::CLASS:
+            case Leaf::STRUCTURE:
+            case Leaf::INTERFACE:
+            case Leaf::UNION:
+            case Leaf::CLASS2:
+            case Leaf::STRUCTURE2:
+            case Leaf::INTERFACE2:
+            case Leaf::UNION2:
+            {
+                // nested UDTs get their own entry in the database. Members usually point at the forward declaration,
+                // so resolve finds the definition, and its structural hash goes in with the name:
+                // two PDBs that disagree on a nested type can't end up sharing the outer one
+                UdtHeader header;
+                ReadUdtHeader(record, header);
+                hash = Fnv1a(hash, header.name);
+                const uint32_t nested = resolve(typeIndex);
+                return nested == NO_TYPE_DATABASE_LAYOUT ? hash : Fnv1a(hash, layouts[nested].structuralHash);
+            }
+            case Leaf::ENUM:
+            {
+                reader.U16(); // count
+                reader.U16(); // property
+                const uint32_t underlyingType = reader.U32();
+                reader.U32(); // field list
+                hash = Fnv1a(hash, underlyingType);
+                return Fnv1a(hash, reader.String());
+            }
+            default:
+            {
+                return hash;
+            }
+        }
+    }
+
+    // what binmerge needs to know about the bytes of a member, see TypeDatabaseField
+    struct FieldType
+    {
+        uint64_t size = 0;
+        Type type = BYTE;
+        Type elementType = BYTE;
+        uint32_t elementCount = 0;
+    };
+    FieldType DescribePrimitive(uint32_t typeIndex)
+    {
+        // pointers to primitives have the pointer mode in bits 8-11
+        const uint32_t mode = (typeIndex >> 8) & 0xF;
+        if (mode == 0x6)
+        {
+            return { 8, LONG };
+        }
+        if (mode == 0x4 || mode == 0x5)
+        {
+            return { 4, INTEGER };
+        }
+        if (mode != 0)
+        {
+            return {}; // 16 bit pointers, not something we'll find in a file
+        }
+        switch (typeIndex & 0xFF)
+        {
+            case 0x10: case 0x20: case 0x30: case 0x68: case 0x69: case 0x70: case 0x7c: return { 1, BYTE };
+            case 0x11: case 0x21: case 0x31: case 0x71: case 0x72: case 0x73: case 0x7a: return { 2, SHORT };
+            case 0x12: case 0x22: case 0x32: case 0x74: case 0x75: case 0x7b: return { 4, INTEGER };
+            case 0x13: case 0x23: case 0x33: case 0x76: case 0x77: return { 8, LONG };
+            case 0x40: return { 4, FLOAT };
+            case 0x41: return { 8, DOUBLE };
+            default: return {}; // void, 128 bit integers, long double...
+        }
+    }
+    // char, signed char and char8_t (and const versions of them): an array of these is a string
+    bool IsCharacterType(const TypeTable& typeTable, uint32_t typeIndex)
+    {
+        const PDB::CodeView::TPI::Record* record = typeTable.GetTypeRecord(typeIndex);
+        if (typeIndex >= typeTable.GetFirstTypeIndex())
+        {
+            if (!record || GetKind(record) != Leaf::MODIFIER)
+            {
+                return false;
+            }
+            LeafReader reader(record);
+            return IsCharacterType(typeTable, reader.U32());
+        }
+        return typeIndex == 0x10 || typeIndex == 0x70 || typeIndex == 0x7c;
+    }
+    // resolve(typeIndex) gives the database layout of a UDT, like for HashFieldType. Members point at forward
+    // declarations (size 0), it's the definition that has the size
+    template <typename Resolve>
+    FieldType DescribeFieldType(const TypeTable& typeTable, uint32_t typeIndex, const std::vector<TypeDatabaseLayout>& layouts, Resolve&& resolve)
+    {
+        if (typeIndex < typeTable.GetFirstTypeIndex())
+        {
+            return DescribePrimitive(typeIndex);
+        }
+        const PDB::CodeView::TPI::Record* record = typeTable.GetTypeRecord(typeIndex);
+        if (!record)
+        {
+            return {};
+        }
+        const uint16_t kind = GetKind(record);
+        LeafReader reader(record);
+        switch (kind)
+        {
+            case Leaf::MODIFIER:
+            {
+                return DescribeFieldType(typeTable, reader.U32(), layouts, resolve);
+            }
+            case Leaf::POINTER:
+            {
+                reader.U32(); // pointee
+                const uint64_t size = (reader.U32() >> 13) & 0x3F;
+                return { size, size == 8 ? LONG : size == 4 ? INTEGER : BYTE };
+            }
+            case Leaf::ARRAY:
+            {
+                const uint32_t elementTypeIndex = reader.U32();
+                reader.U32(); // index type
+                FieldType array = { reader.Numeric(), ARRAY };
+                const FieldType element = DescribeFieldType(typeTable, elementTypeIndex, layouts, resolve);
+                if (element.size == 0 || array.size % element.size != 0)
+                {
+                    array.type = BYTE;
+                    return array;
+                }
+                if (IsCharacterType(typeTable, elementTypeIndex))
+                {
+                    array.type = CSTRING;
+                    return array;
+                }
+                // elements that aren't plain numbers (structures, inner arrays) are compared as opaque bytes
+                const bool isNumber = element.type != STRUCTURE && element.type != ARRAY && element.type != CSTRING;
+                array.elementType = isNumber ? element.type : BYTE;
+                array.elementCount = static_cast<uint32_t>(array.size / element.size);
+                return array;
+            }
+            case Leaf::BITFIELD:
+            {
+                // the storage unit
+                return DescribeFieldType(typeTable, reader.U32(), layouts, resolve);
+            }
+            case Leaf::CLASS:
+            case Leaf::STRUCTURE:
+            case Leaf::INTERFACE:
+            case Leaf::UNION:
+            case Leaf::CLASS2:
+            case Leaf::STRUCTURE2:
+            case Leaf::INTERFACE2:
+            case Leaf::UNION2:
+            {
+                const uint32_t nested = resolve(typeIndex);
+                if (nested == NO_TYPE_DATABASE_LAYOUT)
+                {
+                    return {};
+                }
+                const bool isUnion = kind == Leaf::UNION || kind == Leaf::UNION2;
+                return { layouts[nested].size, isUnion ? BYTE : STRUCTURE };
+            }
+            case Leaf::ENUM:
+            {
+                reader.U16(); // count
+                reader.U16(); // property
+                return DescribeFieldType(typeTable, reader.U32(), layouts, resolve);
+            }
+            default:
+            {
+                return {};
+            }
+        }
+    }
+
+    bool AreLayoutsSame(const TypeDatabaseLayout& first, const TypeDatabaseLayout& second)
+    {
+        if (first.size != second.size || first.name != second.name || first.fields.size() != second.fields.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < first.fields.size(); i++)
+        {
+            const TypeDatabaseField& a = first.fields[i];
+            const TypeDatabaseField& b = second.fields[i];
+            if (a.offset != b.offset || a.typeHash != b.typeHash || a.bitPosition != b.bitPosition || a.bitWidth != b.bitWidth ||
+                a.layoutIndex != b.layoutIndex || a.name != b.name)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // fills in layout.fields from the UDT's field list. Returns false if the list had something we couldn't parse.
+    // resolve(typeIndex, nameOut) is the nested UDT lookup, see TypeDatabase::ResolveUdt
+    template <typename Resolve>
+    bool ReadFields(const TypeTable& typeTable, uint32_t fieldListIndex, TypeDatabaseLayout& layout, const std::vector<TypeDatabaseLayout>& layouts, Resolve&& resolve)
+    {
+        auto resolveLayout = [&](uint32_t typeIndex) { return resolve(typeIndex, nullptr); };
+        auto describe = [&](TypeDatabaseField& field, uint32_t typeIndex)
+        {
+            const FieldType fieldType = DescribeFieldType(typeTable, typeIndex, layouts, resolveLayout);
+            field.size = fieldType.size;
+            field.type = fieldType.type;
+            field.elementType = fieldType.elementType;
+            field.elementCount = fieldType.elementCount;
+        };
+        // long field lists are split over several LF_FIELDLIST records, chained with LF_INDEX
+        while (fieldListIndex != 0)
+        {
+            const PDB::CodeView::TPI::Record* record = typeTable.GetTypeRecord(fieldListIndex);
+            if (!record || GetKind(record) != Leaf::FIELDLIST)
+            {
+                return false;
+            }
+            fieldListIndex = 0;
+            LeafReader reader(record);
+            while (!reader.AtEnd())
+            {
+                const uint16_t kind = reader.U16();
+                switch (kind)
+                {
+                    case Leaf::MEMBER:
+                    {
+                        reader.U16(); // attributes
+                        const uint32_t type = reader.U32();
+                        TypeDatabaseField field;
+                        field.offset = reader.Numeric();
+                        field.name = reader.String();
+                        field.typeHash = HashFieldType(typeTable, type, layouts, resolveLayout);
+                        field.layoutIndex = resolve(type, &field.typeName);
+                        describe(field, type);
+                        const PDB::CodeView::TPI::Record* typeRecord = typeTable.GetTypeRecord(type);
+                        if (type >= typeTable.GetFirstTypeIndex() && typeRecord && GetKind(typeRecord) == Leaf::BITFIELD)
+                        {
+                            LeafReader bitfield(typeRecord);
+                            bitfield.U32(); // base type
+                            field.bitWidth = bitfield.U8();
+                            field.bitPosition = bitfield.U8();
+                        }
+                        layout.fields.push_back(std::move(field));
+                    } break;
+                    case Leaf::BCLASS:
+                    {
+                        // non-virtual bases sit at a fixed offset, so they're part of the layout like a member
+                        reader.U16();
+                        const uint32_t type = reader.U32();
+                        TypeDatabaseField field;
+                        field.offset = reader.Numeric();
+                        field.name = "__base";
+                        field.typeHash = HashFieldType(typeTable, type, layouts, resolveLayout);
+                        field.layoutIndex = resolve(type, &field.typeName);
+                        describe(field, type);
+                        layout.fields.push_back(std::move(field));
+                    } break;
+                    case Leaf::VFUNCTAB:
+                    {
+                        reader.U16();
+                        TypeDatabaseField field;
+                        field.name = "__vfptr";
+                        const uint32_t type = reader.U32();
+                        field.typeHash = HashFieldType(typeTable, type, layouts, resolveLayout);
+                        describe(field, type);
+                        layout.fields.push_back(std::move(field));
+                    } break;
+                    case Leaf::VBCLASS:
+                    case Leaf::IVBCLASS:
+                    {
+                        // virtual bases don't have a fixed offset, nothing we can merge there
+                        reader.U16();
+                        reader.U32(); // base type
+                        reader.U32(); // vbptr type
+                        reader.Numeric(); // vbptr offset
+                        reader.Numeric(); // vbtable index
+                    } break;
+                    case Leaf::STMEMBER:
+                    {
+                        reader.U16();
+                        reader.U32();
+                        reader.String();
+                    } break;
+                    case Leaf::METHOD:
+                    {
+                        reader.U16(); // overload count
+                        reader.U32(); // method list
+                        reader.String();
+                    } break;
+                    case Leaf::ONEMETHOD:
+                    {
+                        const uint16_t attributes = reader.U16();
+                        reader.U32();
+                        const uint16_t methodProperty = (attributes >> 2) & 0x7;
+                        if (methodProperty == 4 || methodProperty == 6)
+                        {
+                            reader.U32(); // introducing virtual methods carry their vtable offset
+                        }
+                        reader.String();
+                    } break;
+                    case Leaf::NESTTYPE:
+                    {
+                        reader.U16();
+                        reader.U32();
+                        reader.String();
+                    } break;
+                    case Leaf::ENUMERATE:
+                    {
+                        reader.U16();
+                        reader.Numeric();
+                        reader.String();
+                    } break;
+                    case Leaf::INDEX:
+                    {
+                        reader.U16();
+                        fieldListIndex = reader.U32();
+                    } break;
+                    default:
+                    {
+                        // no idea how long this entry is, so we can't find the next one
+                        return false;
+                    }
+                }
+                reader.SkipPadding();
+            }
+            if (!reader.ok)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+struct TypeDatabase::AddContext
+{
+    uint32_t pdbIndex;
+    const TypeTable& typeTable;
+    // unique name (or name, without one) -> type index of its definition. Members point at forward declarations,
+    // this is how we find the real thing
+    std::unordered_map<std::string, uint32_t> definitions;
+    // keys with more than one definition. A forward declaration of one of those could mean any of them, so it isn't resolved
+    std::unordered_set<std::string> ambiguous;
+    // per type index (from the first one): UNVISITED, IN_PROGRESS, or the index into m_layouts.
+    // Sized once up front, so references into it stay valid while nested UDTs are added
+    std::vector<uint32_t> layoutOfType;
+};
+static constexpr uint32_t UNVISITED = NO_TYPE_DATABASE_LAYOUT - 1;
+static constexpr uint32_t IN_PROGRESS = NO_TYPE_DATABASE_LAYOUT - 2;
+
+uint32_t TypeDatabase::AddTypes(const char* pdbName, const TypeTable& typeTable)
+{
+    const uint32_t pdbIndex = static_cast<uint32_t>(m_pdbNames.size());
+    m_pdbNames.emplace_back(pdbName);
+
+    AddContext context = { pdbIndex, typeTable, {}, {}, {} };
+    const uint32_t firstIndex = typeTable.GetFirstTypeIndex();
+    context.layoutOfType.assign(typeTable.GetLastTypeIndex() - firstIndex, UNVISITED);
+    for (uint32_t typeIndex = firstIndex; typeIndex < typeTable.GetLastTypeIndex(); typeIndex++)
+    {
+        const PDB::CodeView::TPI::Record* record = typeTable.GetTypeRecord(typeIndex);
+        UdtHeader header;
+        if (record && IsUdtKind(GetKind(record)) && ReadUdtHeader(record, header) && !(header.property & Leaf::PROPERTY_FWDREF))
+        {
+            // the type stream stores identical records once, so a second definition under the same key is a different type
+            if (!context.definitions.emplace(GetDefinitionKey(header), typeIndex).second)
+            {
+                context.ambiguous.emplace(GetDefinitionKey(header));
+            }
+        }
+    }
+    // nested UDTs get added as they're needed, so by the time a layout is hashed its members are in already
+    for (uint32_t typeIndex = firstIndex; typeIndex < typeTable.GetLastTypeIndex(); typeIndex++)
+    {
+        AddUdt(context, typeIndex);
+    }
+    return pdbIndex;
+}
+
+uint32_t TypeDatabase::ResolveUdt(AddContext& context, uint32_t typeIndex, std::string* nameOut)
+{
+    const TypeTable& typeTable = context.typeTable;
+    // through const/volatile and arrays, down to what actually sits in the bytes
+    for (;;)
+    {
+        const PDB::CodeView::TPI::Record* record = typeTable.GetTypeRecord(typeIndex);
+        if (typeIndex < typeTable.GetFirstTypeIndex() || !record)
+        {
+            return NO_TYPE_DATABASE_LAYOUT;
+        }
+        const uint16_t kind = GetKind(record);
+        if (kind == Leaf::MODIFIER || kind == Leaf::ARRAY)
+        {
+            LeafReader reader(record);
+            typeIndex = reader.U32(); // the modified type and the element type both come first
+            continue;
+        }
+        UdtHeader header;
+        if (!IsUdtKind(kind) || !ReadUdtHeader(record, header))
+        {
+            return NO_TYPE_DATABASE_LAYOUT;
+        }
+        if (nameOut)
+        {
+            *nameOut = header.name;
+        }
+        if (!(header.property & Leaf::PROPERTY_FWDREF))
+        {
+            // pointing at the definition already (anonymous types always do), nothing to look up
+            return AddUdt(context, typeIndex);
+        }
+        const char* key = GetDefinitionKey(header);
+        auto definition = context.definitions.find(key);
+        if (definition == context.definitions.end() || context.ambiguous.count(key))
+        {
+            return NO_TYPE_DATABASE_LAYOUT;
+        }
+        return AddUdt(context, definition->second);
+    }
+}
+
+uint32_t TypeDatabase::AddUdt(AddContext& context, uint32_t typeIndex)
+{
+    const TypeTable& typeTable = context.typeTable;
+    uint32_t& state = context.layoutOfType[typeIndex - typeTable.GetFirstTypeIndex()];
+    if (state != UNVISITED)
+    {
+        // IN_PROGRESS means a UDT contains itself by value, only a broken PDB does that
+        return state == IN_PROGRESS ? NO_TYPE_DATABASE_LAYOUT : state;
+    }
+    const PDB::CodeView::TPI::Record* record = typeTable.GetTypeRecord(typeIndex);
+    UdtHeader header;
+    if (!record || !IsUdtKind(GetKind(record)) || !ReadUdtHeader(record, header) || (header.property & Leaf::PROPERTY_FWDREF))
+    {
+        // forward declarations have no fields, the definition shows up under its own index
+        state = NO_TYPE_DATABASE_LAYOUT;
+        return state;
+    }
+    state = IN_PROGRESS;
+
+    TypeDatabaseLayout candidate;
+    candidate.name = header.name;
+    candidate.size = header.size;
+    auto resolve = [&](uint32_t memberType, std::string* nameOut) { return ResolveUdt(context, memberType, nameOut); };
+    if (!ReadFields(typeTable, header.fieldList, candidate, m_layouts, resolve))
+    {
+        state = NO_TYPE_DATABASE_LAYOUT;
+        return state;
+    }
+    uint64_t hash = Fnv1a(FNV_OFFSET, GetKind(record));
+    hash = Fnv1a(hash, header.name);
+    hash = Fnv1a(hash, candidate.size);
+    for (const TypeDatabaseField& field : candidate.fields)
+    {
+        hash = Fnv1a(hash, field.name.c_str());
+        hash = Fnv1a(hash, field.offset);
+        hash = Fnv1a(hash, field.typeHash);
+        hash = Fnv1a(hash, field.bitPosition);
+        hash = Fnv1a(hash, field.bitWidth);
+    }
+    candidate.structuralHash = hash;
+
+    uint32_t layoutIndex = NO_TYPE_DATABASE_LAYOUT;
+    auto [begin, end] = m_layoutsByHash.equal_range(hash);
+    for (auto it = begin; it != end; ++it)
+    {
+        if (AreLayoutsSame(m_layouts[it->second], candidate))
+        {
+            layoutIndex = it->second;
+            break;
+        }
+    }
+    if (layoutIndex == NO_TYPE_DATABASE_LAYOUT)
+    {
+        layoutIndex = static_cast<uint32_t>(m_layouts.size());
+        m_layouts.push_back(std::move(candidate));
+        m_layoutsByHash.emplace(hash, layoutIndex);
+    }
+    m_layouts[layoutIndex].references.push_back({ context.pdbIndex, typeIndex });
+    m_layoutByReference[(static_cast<uint64_t>(context.pdbIndex) << 32) | typeIndex] = layoutIndex;
+    state = layoutIndex;
+    return layoutIndex;
+}
+
+const TypeDatabaseLayout* TypeDatabase::FindLayout(uint32_t pdbIndex, uint32_t typeIndex) const
+{
+    auto it = m_layoutByReference.find((static_cast<uint64_t>(pdbIndex) << 32) | typeIndex);
+    return it == m_layoutByReference.end() ? nullptr : &m_layouts[it->second];
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "typetable.h"
+#include "../type_enumeration.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// we pull layouts out of lots of PDBs (game, editor, tools, and several builds of each),
+// and most of them define the exact same structures. Rather than keeping a copy of every UDT
+// per PDB, each UDT is hashed by its structure (field names, offsets and field types), and
+// identical structures are stored once. Every (pdb, type index) that has that structure just references it.
+
+constexpr uint32_t NO_TYPE_DATABASE_LAYOUT = UINT32_MAX;
+
+struct TypeDatabaseField
+{
+    std::string name;
+    uint64_t offset = 0;
+    // structural description of the field's type. Primitives are their (stable) type index,
+    // nested UDTs are their name plus their own structural hash, so this is the same across PDBs
+    // exactly when the nested layouts are the same too
+    uint64_t typeHash = 0;
+    // what the bytes are, in binmerge's terms (see type_enumeration.h). Primitives by their size, pointers and enums
+    // as integers, UDTs as STRUCTURE (unions are BYTE, their members overlap so they're one opaque value),
+    // char arrays as CSTRING and other arrays as ARRAY of their element. Size 0 means we couldn't tell
+    uint64_t size = 0;
+    Type type = BYTE;
+    Type elementType = BYTE; // only for ARRAY
+    uint32_t elementCount = 0; // only for ARRAY
+    // for members that are a UDT (or an array of them, or a base class): its name, and its layout in the database.
+    // Since the nested structure is part of typeHash, every PDB that shares this layout shares the nested one too
+    std::string typeName;
+    uint32_t layoutIndex = NO_TYPE_DATABASE_LAYOUT; // index into TypeDatabase::GetLayouts()
+    // only for bitfields, width 0 means "not a bitfield"
+    uint8_t bitPosition = 0;
+    uint8_t bitWidth = 0;
+};
+
+struct TypeDatabaseReference
+{
+    uint32_t pdbIndex;
+    uint32_t typeIndex;
+};
+
+struct TypeDatabaseLayout
+{
+    std::string name;
+    uint64_t size = 0;
+    uint64_t structuralHash = 0;
+    std::vector<TypeDatabaseField> fields;
+    std::vector<TypeDatabaseReference> references; // every place this exact layout showed up
+};
+
+class TypeDatabase
+{
+public:
+    // walks every UDT in the type table and adds the ones we haven't seen the structure of yet.
+    // Returns the index this pdb is referred to by in TypeDatabaseReference
+    uint32_t AddTypes(const char* pdbName, const TypeTable& typeTable);
+
+    // nullptr if that type isn't a UDT with a definition
+    const TypeDatabaseLayout* FindLayout(uint32_t pdbIndex, uint32_t typeIndex) const;
+
+    inline const std::vector<TypeDatabaseLayout>& GetLayouts(void) const { return m_layouts; }
+    inline const std::vector<std::string>& GetPdbNames(void) const { return m_pdbNames; }
+    inline size_t GetReferenceCount(void) const { return m_layoutByReference.size(); }
+
+private:
+    struct AddContext;
+    // adds the UDT definition at typeIndex, and the nested UDTs it needs first. Returns its index in m_layouts
+    uint32_t AddUdt(AddContext& context, uint32_t typeIndex);
+    // layout of the UDT a member's type ends up at (through modifiers and arrays), NO_TYPE_DATABASE_LAYOUT if it isn't one
+    uint32_t ResolveUdt(AddContext& context, uint32_t typeIndex, std::string* nameOut = nullptr);
+
+    std::vector<std::string> m_pdbNames;
+    std::vector<TypeDatabaseLayout> m_layouts;
+    // structural hash -> indices into m_layouts. Multimap, because a hash match still has to be checked field by field
+    std::unordered_multimap<uint64_t, uint32_t> m_layoutsByHash;
+    // (pdbIndex << 32 | typeIndex) -> index into m_layouts
+    std::unordered_map<uint64_t, uint32_t> m_layoutByReference;
+};
@@ -4,9 +4,47 @@
 //#include "Examples_PCH.h"
 #include "typetable.h"
 #include "Foundation/PDB_Memory.h"
+#include "../parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
 
 // https://github.com/MolecularMatters/raw_pdb/blob/main/src/Examples/ExampleTypeTable.cpp
 
+namespace
+{
+	// on-disk TPI stream header. Only the parts we need for the index offset buffer are used,
+	// the rest is just here to get the layout right.
+	struct TPIStreamHeader
+	{
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t typeIndexBegin;
+		uint32_t typeIndexEnd;
+		uint32_t typeRecordBytes;
+		uint16_t hashStreamIndex;
+		uint16_t hashAuxStreamIndex;
+		uint32_t hashKeySize;
+		uint32_t hashBucketCount;
+		int32_t hashValueBufferOffset;
+		uint32_t hashValueBufferLength;
+		int32_t indexOffsetBufferOffset;
+		uint32_t indexOffsetBufferLength;
+		int32_t hashAdjBufferOffset;
+		uint32_t hashAdjBufferLength;
+	};
+
+	// one entry in the hash stream's index offset buffer. Roughly every 8KB of type records,
+	// the linker writes down which type index starts where, relative to the end of the TPI header.
+	struct TypeIndexOffset
+	{
+		uint32_t typeIndex;
+		uint32_t offset;
+	};
+
+	constexpr uint16_t INVALID_STREAM_INDEX = 0xFFFFu;
+}
+
 TypeTable::TypeTable(const PDB::TPIStream& tpiStream) PDB_NO_EXCEPT
 	: typeIndexBegin(tpiStream.GetFirstTypeIndex()), typeIndexEnd(tpiStream.GetLastTypeIndex()),
 	m_recordCount(tpiStream.GetTypeRecordCount())
@@ -18,9 +56,28 @@ TypeTable::TypeTable(const PDB::TPIStream& tpiStream) PDB_NO_EXCEPT
 	// types in the TPI stream are accessed by their index from other streams.
 	// however, the index is not stored with types in the TPI stream directly, but has to be built while walking the stream.
 	// similarly, because types are variable-length records, there are no direct offsets to access individual types.
-	// we therefore walk the TPI stream once, and store pointers to the records for trivial O(1) array lookup by index later.	
+	// we therefore walk the TPI stream once, and store pointers to the records for trivial O(1) array lookup by index later.
+	m_records = PDB_NEW_ARRAY(const PDB::CodeView::TPI::Record*, m_recordCount);
+
+	FillRecordsSerial(tpiStream);
+}
+
+TypeTable::TypeTable(const PDB::RawFile& rawPdbFile, const PDB::TPIStream& tpiStream, uint32_t threadCount) PDB_NO_EXCEPT
+	: typeIndexBegin(tpiStream.GetFirstTypeIndex()), typeIndexEnd(tpiStream.GetLastTypeIndex()),
+	m_recordCount(tpiStream.GetTypeRecordCount())
+{
+	const PDB::DirectMSFStream& directStream = tpiStream.GetDirectMSFStream();
+	m_stream = PDB::CoalescedMSFStream(directStream, directStream.GetSize(), 0);
 	m_records = PDB_NEW_ARRAY(const PDB::CodeView::TPI::Record*, m_recordCount);
 
+	if (!FillRecordsParallel(rawPdbFile, tpiStream, threadCount))
+	{
+		FillRecordsSerial(tpiStream);
+	}
+}
+
+void TypeTable::FillRecordsSerial(const PDB::TPIStream& tpiStream) PDB_NO_EXCEPT
+{
 	// parse the CodeView records
 	uint32_t typeIndex = 0u;
 
@@ -37,6 +94,85 @@ TypeTable::TypeTable(const PDB::TPIStream& tpiStream) PDB_NO_EXCEPT
 		});
 }
 
+bool TypeTable::FillRecordsParallel(const PDB::RawFile& rawPdbFile, const PDB::TPIStream& tpiStream, uint32_t threadCount) PDB_NO_EXCEPT
+{
+	const PDB::DirectMSFStream& directStream = tpiStream.GetDirectMSFStream();
+	const size_t streamSize = directStream.GetSize();
+	if (streamSize < sizeof(TPIStreamHeader) || m_recordCount == 0)
+	{
+		return false;
+	}
+	const TPIStreamHeader header = directStream.ReadAtOffset<TPIStreamHeader>(0);
+	if (header.hashStreamIndex == INVALID_STREAM_INDEX || header.indexOffsetBufferLength < sizeof(TypeIndexOffset) || header.indexOffsetBufferOffset < 0)
+	{
+		return false;
+	}
+
+	const PDB::DirectMSFStream hashStream = rawPdbFile.CreateMSFStream<PDB::DirectMSFStream>(header.hashStreamIndex);
+	const size_t hintCount = header.indexOffsetBufferLength / sizeof(TypeIndexOffset);
+	if (static_cast<size_t>(header.indexOffsetBufferOffset) + hintCount * sizeof(TypeIndexOffset) > hashStream.GetSize())
+	{
+		return false;
+	}
+	std::vector<TypeIndexOffset> hints(hintCount);
+	hashStream.ReadAtOffset(hints.data(), hintCount * sizeof(TypeIndexOffset), static_cast<size_t>(header.indexOffsetBufferOffset));
+
+	// the hints are relative to the end of the header, our offsets are relative to the start of the stream.
+	// Also make sure they're usable: sorted, in range, and starting at the first type
+	for (size_t i = 0; i < hints.size(); i++)
+	{
+		hints[i].offset += header.headerSize;
+		const bool inRange = hints[i].typeIndex >= typeIndexBegin && hints[i].typeIndex < typeIndexEnd && hints[i].offset < streamSize;
+		const bool sorted = i == 0 || (hints[i].typeIndex > hints[i - 1].typeIndex && hints[i].offset > hints[i - 1].offset);
+		if (!inRange || !sorted)
+		{
+			return false;
+		}
+	}
+	if (hints[0].typeIndex != typeIndexBegin)
+	{
+		hints.insert(hints.begin(), TypeIndexOffset { typeIndexBegin, header.headerSize });
+	}
+
+	// a few chunks per thread, so one slow chunk doesn't hold everybody up
+	const size_t chunkCount = std::min<size_t>(hints.size(), static_cast<size_t>(ResolveThreadCount(threadCount)) * 4u);
+	const size_t hintsPerChunk = (hints.size() + chunkCount - 1) / chunkCount;
+
+	std::atomic<bool> failed = false;
+	ParallelFor(chunkCount, threadCount, [&](size_t chunk)
+	{
+		const size_t firstHint = chunk * hintsPerChunk;
+		if (failed || firstHint >= hints.size())
+		{
+			return;
+		}
+		const size_t endHint = firstHint + hintsPerChunk;
+		const uint32_t endTypeIndex = endHint < hints.size() ? hints[endHint].typeIndex : typeIndexEnd;
+		const size_t endOffset = endHint < hints.size() ? hints[endHint].offset : streamSize;
+
+		// same walk as the serial version, just starting from a known (index, offset) instead of the beginning
+		size_t offset = hints[firstHint].offset;
+		for (uint32_t typeIndex = hints[firstHint].typeIndex; typeIndex < endTypeIndex; ++typeIndex)
+		{
+			if (offset + sizeof(PDB::CodeView::TPI::RecordHeader) > endOffset)
+			{
+				failed = true;
+				return;
+			}
+			const PDB::CodeView::TPI::Record* record = m_stream.GetDataAtOffset<const PDB::CodeView::TPI::Record>(offset);
+			m_records[typeIndex - typeIndexBegin] = record;
+			// the size doesn't include the size field itself
+			offset += record->header.size + sizeof(uint16_t);
+		}
+		// if the walk didn't land exactly on the next hint, the hints are lying to us
+		if (offset != endOffset && endHint < hints.size())
+		{
+			failed = true;
+		}
+	});
+	return !failed;
+}
+
 TypeTable::~TypeTable() PDB_NO_EXCEPT
 {
 	PDB_DELETE_ARRAY(m_records);
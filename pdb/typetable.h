@@ -2,6 +2,7 @@
 
 #include "PDB_TPIStream.h"
 #include "PDB_CoalescedMSFStream.h"
+#include "PDB_RawFile.h"
 #include <string>
 
 // https://github.com/MolecularMatters/raw_pdb/blob/main/src/Examples/ExampleTypeTable.h
@@ -10,6 +11,10 @@ class TypeTable
 {
 public:
 	explicit TypeTable(const PDB::TPIStream& tpiStream) PDB_NO_EXCEPT;
+	// same thing, but uses the (type index, offset) hints from the TPI hash stream to split the
+	// stream into chunks and find the records of each chunk on its own thread.
+	// Falls back to the serial walk if the PDB doesn't have the hints, or they don't add up.
+	TypeTable(const PDB::RawFile& rawPdbFile, const PDB::TPIStream& tpiStream, uint32_t threadCount = 0) PDB_NO_EXCEPT;
 	~TypeTable() PDB_NO_EXCEPT;
 
 	// Returns the index of the first type, which is not necessarily zero.
@@ -40,6 +45,9 @@ public:
 	}
 
 private:
+	void FillRecordsSerial(const PDB::TPIStream& tpiStream) PDB_NO_EXCEPT;
+	bool FillRecordsParallel(const PDB::RawFile& rawPdbFile, const PDB::TPIStream& tpiStream, uint32_t threadCount) PDB_NO_EXCEPT;
+
 	uint32_t typeIndexBegin;
 	uint32_t typeIndexEnd;
 
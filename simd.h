@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#ifdef _MSC_VER
+    #include <intrin.h>
+#endif
+
+// which vector instruction sets we're allowed to use, decided at compile time.
+// Everything that uses these also has a plain scalar path, so on anything else (arm, 32 bit x86 without sse2)
+// we still build and produce the same results, just slower.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BINMERGE_SSE2 1
+    #include <emmintrin.h>
+#else
+    #define BINMERGE_SSE2 0
+#endif
+
+// index of the lowest set bit. mask must not be 0
+inline uint32_t CountTrailingZeros64(uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return (uint32_t)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, (uint32_t)mask))
+    {
+        return (uint32_t)index;
+    }
+    _BitScanForward(&index, (uint32_t)(mask >> 32));
+    return (uint32_t)index + 32;
+#else
+    return (uint32_t)__builtin_ctzll(mask);
+#endif
+}
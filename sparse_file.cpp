@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cstring>
+
+#include "sparse_file.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#else
+// we use std::min/std::max here, don't let the Windows macros eat them
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <winioctl.h>
+#endif
+
+
+void FindDataRanges(const MemoryMappedFile::Handle& file, std::vector<ByteRange>& data)
+{
+    data.clear();
+    if (file.len == 0)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    FILE_ALLOCATED_RANGE_BUFFER query = {};
+    query.FileOffset.QuadPart = 0;
+    query.Length.QuadPart = (LONGLONG)file.len;
+    FILE_ALLOCATED_RANGE_BUFFER ranges[64];
+    for (;;)
+    {
+        DWORD bytes = 0;
+        const BOOL done = DeviceIoControl(file.file, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), ranges, sizeof(ranges), &bytes, nullptr);
+        if (!done && GetLastError() != ERROR_MORE_DATA)
+        {
+            // not NTFS/ReFS or similar, treat it all as data
+            data.assign(1, { 0, file.len });
+            return;
+        }
+        const DWORD count = bytes / sizeof(ranges[0]);
+        for (DWORD i = 0; i < count; i++)
+        {
+            const size_t start = (size_t)ranges[i].FileOffset.QuadPart;
+            data.push_back({ start, std::min((size_t)ranges[i].Length.QuadPart, file.len - start) });
+        }
+        if (done || count == 0)
+        {
+            break;
+        }
+        // more where that came from, carry on after the last one we got
+        const LONGLONG next = ranges[count - 1].FileOffset.QuadPart + ranges[count - 1].Length.QuadPart;
+        query.Length.QuadPart -= next - query.FileOffset.QuadPart;
+        query.FileOffset.QuadPart = next;
+    }
+#elif defined(SEEK_DATA) && defined(SEEK_HOLE)
+    // the mapping doesn't care where the file position is, so we're free to move it around
+    off_t cursor = 0;
+    while ((size_t)cursor < file.len)
+    {
+        const off_t start = lseek(file.file, cursor, SEEK_DATA);
+        if (start < 0)
+        {
+            if (errno == ENXIO)
+            {
+                break; // nothing but hole from here to the end
+            }
+            data.assign(1, { 0, file.len });
+            return;
+        }
+        off_t end = lseek(file.file, start, SEEK_HOLE);
+        if (end < 0 || (size_t)end > file.len)
+        {
+            end = (off_t)file.len;
+        }
+        data.push_back({ (size_t)start, (size_t)(end - start) });
+        cursor = end;
+    }
+#else
+    data.assign(1, { 0, file.len });
+#endif
+}
+
+void UniteDataRanges(const std::vector<ByteRange>* lists, size_t listCount, std::vector<ByteRange>& data)
+{
+    data.clear();
+    for (size_t i = 0; i < listCount; i++)
+    {
+        data.insert(data.end(), lists[i].begin(), lists[i].end());
+    }
+    std::sort(data.begin(), data.end(), [](const ByteRange& a, const ByteRange& b) { return a.offset < b.offset; });
+    size_t count = 0;
+    for (const ByteRange& range : data)
+    {
+        if (count > 0 && range.offset <= data[count - 1].offset + data[count - 1].size)
+        {
+            ByteRange& last = data[count - 1];
+            last.size = std::max(last.offset + last.size, range.offset + range.size) - last.offset;
+        }
+        else
+        {
+            data[count++] = range;
+        }
+    }
+    data.resize(count);
+}
+
+// calls fn(start, end) for every data span inside [offset, offset + size), clipped to it
+template <typename Fn>
+static void ForEachDataSpan(const std::vector<ByteRange>& data, size_t offset, size_t size, Fn&& fn)
+{
+    const size_t end = offset + size;
+    // first range that ends after offset
+    auto it = std::upper_bound(data.begin(), data.end(), offset,
+        [](size_t value, const ByteRange& range) { return value < range.offset + range.size; });
+    for (; it != data.end() && it->offset < end; ++it)
+    {
+        if (!fn(std::max(it->offset, offset), std::min(it->offset + it->size, end)))
+        {
+            return;
+        }
+    }
+}
+
+bool IsAllHole(const std::vector<ByteRange>& data, size_t offset, size_t size)
+{
+    bool hole = true;
+    ForEachDataSpan(data, offset, size, [&](size_t, size_t) { hole = false; return false; });
+    return hole;
+}
+
+void CopySparse(char* dst, const char* src, size_t offset, size_t size, const std::vector<ByteRange>& data)
+{
+    size_t cursor = offset;
+    ForEachDataSpan(data, offset, size, [&](size_t start, size_t end)
+    {
+        memset(dst + (cursor - offset), 0, start - cursor);
+        memcpy(dst + (start - offset), src + start, end - start);
+        cursor = end;
+        return true;
+    });
+    memset(dst + (cursor - offset), 0, offset + size - cursor);
+}
+
+bool CompareSparse(const char* one, const char* two, size_t offset, size_t size, const std::vector<ByteRange>& data)
+{
+    bool same = true;
+    ForEachDataSpan(data, offset, size, [&](size_t start, size_t end)
+    {
+        same = memcmp(one + start, two + start, end - start) == 0;
+        return same;
+    });
+    return same;
+}
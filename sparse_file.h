@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "output_writer.h"
+#include "pdb/mapped_file.h"
+
+
+// sparse files: big zero-filled regions that the filesystem doesn't store at all (holes).
+// Reading a hole through a mapping still faults in a page of zeros for every 4KB, so on a mostly-empty
+// multi-gigabyte file the merge would spend all its time on zeros.
+// A range that is a hole in every revision is zero in every revision, so it can't be anybody's change:
+// the merge skips it, and the writer leaves (or punches) a hole there instead of writing zeros.
+
+// the parts of file that are actually stored, sorted and coalesced, in whole filesystem blocks.
+// Without hole support (filesystem, OS) that's just the whole file, which makes everything below a no-op
+void FindDataRanges(const MemoryMappedFile::Handle& file, std::vector<ByteRange>& data);
+// everything that's data in at least one of the lists (so whatever isn't in here is a hole in all of them)
+void UniteDataRanges(const std::vector<ByteRange>* lists, size_t listCount, std::vector<ByteRange>& data);
+
+// true if no data range touches [offset, offset + size)
+bool IsAllHole(const std::vector<ByteRange>& data, size_t offset, size_t size);
+// src, one and two below are whole files, offsets are from their start.
+// copies [offset, offset + size) of src to dst[0, size), but only reads src where there's data. Holes are zeroed in dst
+void CopySparse(char* dst, const char* src, size_t offset, size_t size, const std::vector<ByteRange>& data);
+// memcmp == 0 for [offset, offset + size) of two files, skipping the holes (zero in both, so equal)
+bool CompareSparse(const char* one, const char* two, size_t offset, size_t size, const std::vector<ByteRange>& data);
@@ -0,0 +1,266 @@
+#include <assert.h>
+#include <cstdio>
+#include <cstring>
+
+#include "array_merge.h"
+#include "bitfield_merge.h"
+#include "merge_decision.h"
+#include "sparse_file.h"
+#include "three_way_merge.h"
+
+
+// merges rows [firstRow, firstRow + rowCount) of layout's columns, see MergeRecordData.
+// Sets hasBitfields if any of them are bitfields, those are left for MergeBitfields
+static bool MergeRecordRows(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    size_t firstRow,
+    size_t rowCount,
+    const char* base,
+    const char* local,
+    const char* remote,
+    char* merged,
+    const std::vector<ByteRange>* dataRanges,
+    bool& hasBitfields)
+{
+    // only the columns are touched per field, the FieldData is just for arrays and conflict messages
+    const LayoutColumns& columns = layout.columns;
+    bool result = true;
+    for (size_t i = firstRow; i < firstRow + rowCount; i++)
+    {
+        const size_t offset = columns.offsets[i];
+        const size_t size = columns.sizes[i];
+        if (columns.flags[i] & FIELD_FLAG_VARIABLE)
+        {
+            // these don't have a fixed spot in the file, see MergeIndexedData
+            continue;
+        }
+        if (dataRanges && IsAllHole(*dataRanges, offset, size))
+        {
+            continue;
+        }
+        if (columns.flags[i] & FIELD_FLAG_BITFIELD)
+        {
+            // merged bit by bit, all of them in one go below
+            hasBitfields = true;
+            continue;
+        }
+        size_t childRow = 0;
+        size_t childCount = 0;
+        if (GetMergeableChildRows(columns, i, &childRow, &childCount))
+        {
+            // a structure with a nested layout is merged member by member,
+            // so local moving pos.x and remote moving pos.y isn't a conflict
+            result = MergeRecordRows(layout, kernels, childRow, childCount, base, local, remote, merged, dataRanges, hasBitfields) && result;
+            continue;
+        }
+        if (columns.types[i] == ARRAY)
+        {
+            result = MergeArrayField(*columns.fields[i], kernels[i], base + offset, local + offset, remote + offset, merged + offset) && result;
+            continue;
+        }
+        FieldCompareFn compare = kernels[i];
+        bool baseToLocal = compare(base + offset, local + offset, size);
+        bool baseToRemote = compare(base + offset, remote + offset, size);
+        // only worth comparing local against remote when both of them changed
+        bool localToRemote = !baseToLocal && !baseToRemote && compare(local + offset, remote + offset, size);
+        switch (ResolveModification(baseToLocal, baseToRemote, localToRemote))
+        {
+            case MergeDecision::TAKE_BASE: break; // local is the same as base already
+            case MergeDecision::TAKE_LOCAL: break;
+            case MergeDecision::TAKE_REMOTE:
+            {
+                memcpy(merged + offset, remote + offset, size);
+            } break;
+            case MergeDecision::CONFLICT:
+            {
+                const FieldData& field = *columns.fields[i];
+                printf("conflict in field %s: local ", field.name);
+                PrintFieldValue(&layout, &field, local + offset);
+                printf(", remote ");
+                PrintFieldValue(&layout, &field, remote + offset);
+                printf("\n");
+                result = false;
+            } break;
+        }
+    }
+    return result;
+}
+
+bool MergeRecordData(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    const char* base,
+    const char* local,
+    const char* remote,
+    char* merged,
+    const std::vector<ByteRange>* dataRanges)
+{
+    assert(IsLayoutFinalized(&layout));
+    if (dataRanges)
+    {
+        CopySparse(merged, local, 0, GetLayoutExtent(&layout), *dataRanges);
+    }
+    else
+    {
+        memcpy(merged, local, GetLayoutExtent(&layout));
+    }
+    bool hasBitfields = false;
+    bool result = MergeRecordRows(layout, kernels, 0, layout.fieldsCount, base, local, remote, merged, dataRanges, hasBitfields);
+    if (hasBitfields)
+    {
+        BitfieldPlan plan = CompileBitfieldPlan(layout);
+        result = MergeBitfields(layout, plan, base, local, remote, merged) && result;
+    }
+    return result;
+}
+
+
+bool MergeIndexedData(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    const char* base, const FileIndex& baseIndex,
+    const char* local, const FileIndex& localIndex,
+    const char* remote, const FileIndex& remoteIndex,
+    std::vector<char>& merged,
+    const std::vector<ByteRange>* dataRanges)
+{
+    merged.resize(GetLayoutExtent(&layout));
+    bool result = MergeRecordData(layout, kernels, base, local, remote, merged.data(), dataRanges);
+    for (size_t i = 0; i < layout.fieldsCount; i++)
+    {
+        const FieldData& field = layout.fields[i];
+        if (!IsFieldVariable(&field))
+        {
+            continue;
+        }
+        const IndexedField& baseField = baseIndex.fields[i];
+        const IndexedField& localField = localIndex.fields[i];
+        const IndexedField& remoteField = remoteIndex.fields[i];
+        const size_t mergedOffset = merged.size();
+        size_t mergedCount = localField.count;
+        if (field.type != SIZEDBUFFER && baseField.count == localField.count && baseField.count == remoteField.count)
+        {
+            merged.insert(merged.end(), local + localField.offset, local + localField.offset + localField.size);
+            result = MergeArrayElements(
+                field.name, kernels[i], field.size, localField.count,
+                base + baseField.offset, local + localField.offset, remote + remoteField.offset,
+                merged.data() + mergedOffset) && result;
+        }
+        else
+        {
+            auto isSame = [&](const char* one, const IndexedField& oneField, const char* two, const IndexedField& twoField)
+            {
+                return AreElementsSame(kernels[i], field.size, one + oneField.offset, oneField.count, two + twoField.offset, twoField.count);
+            };
+            bool baseToLocal = isSame(base, baseField, local, localField);
+            bool baseToRemote = isSame(base, baseField, remote, remoteField);
+            bool localToRemote = isSame(local, localField, remote, remoteField);
+            const char* source = local;
+            const IndexedField* sourceField = &localField;
+            switch (ResolveModification(baseToLocal, baseToRemote, localToRemote))
+            {
+                case MergeDecision::TAKE_BASE: break; // same bytes as local
+                case MergeDecision::TAKE_LOCAL: break;
+                case MergeDecision::TAKE_REMOTE:
+                {
+                    source = remote;
+                    sourceField = &remoteField;
+                } break;
+                case MergeDecision::CONFLICT:
+                {
+                    printf("conflict in field %s\n", field.name);
+                    result = false;
+                } break;
+            }
+            merged.insert(merged.end(), source + sourceField->offset, source + sourceField->offset + sourceField->size);
+            mergedCount = sourceField->count;
+        }
+        // the count has to agree with whichever version of the field we ended up with
+        const FieldData& countField = layout.fields[field.countField];
+        WriteUnsignedField(merged.data() + countField.offset, countField.size, mergedCount, layout.endianness);
+    }
+    const char* revisions[] = { local, remote };
+    const FileIndex* indices[] = { &localIndex, &remoteIndex };
+    result = CheckOffsetFields(layout, kernels, base, baseIndex, revisions, indices, 2) && result;
+    return result;
+}
+
+bool MergeFiles(
+    const FormatLayout& layout,
+    const char* base, size_t baseLen,
+    const char* local, size_t localLen,
+    const char* remote, size_t remoteLen,
+    std::vector<char>& merged,
+    bool* conflictsOut,
+    const std::vector<ByteRange>* dataRanges)
+{
+    FileIndex baseIndex, localIndex, remoteIndex;
+    if (!BuildFileIndex(layout, base, baseLen, baseIndex) ||
+        !BuildFileIndex(layout, local, localLen, localIndex) ||
+        !BuildFileIndex(layout, remote, remoteLen, remoteIndex))
+    {
+        return false;
+    }
+    std::vector<FieldCompareFn> kernels = SelectCompareKernels(layout);
+    bool result = MergeIndexedData(layout, kernels.data(), base, baseIndex, local, localIndex, remote, remoteIndex, merged, dataRanges);
+
+    // whatever is left after the layout, treated as one opaque value
+    const size_t baseTailSize = baseLen - baseIndex.end;
+    const size_t localTailSize = localLen - localIndex.end;
+    const size_t remoteTailSize = remoteLen - remoteIndex.end;
+    // the holes are at the same place in all three only if nobody resized a variable field
+    const bool sparseTail = dataRanges && baseIndex.end == localIndex.end && baseIndex.end == remoteIndex.end;
+    auto isTailSame = [&](const char* one, size_t oneEnd, size_t oneSize, const char* two, size_t twoEnd, size_t twoSize)
+    {
+        if (oneSize != twoSize)
+        {
+            return false;
+        }
+        return sparseTail ? CompareSparse(one, two, oneEnd, oneSize, *dataRanges) : CompareBytes(one + oneEnd, two + twoEnd, oneSize);
+    };
+    bool baseToLocal = isTailSame(base, baseIndex.end, baseTailSize, local, localIndex.end, localTailSize);
+    bool baseToRemote = isTailSame(base, baseIndex.end, baseTailSize, remote, remoteIndex.end, remoteTailSize);
+    bool localToRemote = isTailSame(local, localIndex.end, localTailSize, remote, remoteIndex.end, remoteTailSize);
+    // a region that isn't data in any of the files is a hole in this one, wherever its tail starts
+    auto appendTail = [&](const char* file, const FileIndex& index, size_t size)
+    {
+        if (dataRanges)
+        {
+            const size_t mergedOffset = merged.size();
+            merged.resize(mergedOffset + size);
+            CopySparse(merged.data() + mergedOffset, file, index.end, size, *dataRanges);
+        }
+        else
+        {
+            merged.insert(merged.end(), file + index.end, file + index.end + size);
+        }
+    };
+    switch (ResolveModification(baseToLocal, baseToRemote, localToRemote))
+    {
+        case MergeDecision::TAKE_BASE:
+        case MergeDecision::TAKE_LOCAL:
+        {
+            appendTail(local, localIndex, localTailSize);
+        } break;
+        case MergeDecision::TAKE_REMOTE:
+        {
+            appendTail(remote, remoteIndex, remoteTailSize);
+        } break;
+        case MergeDecision::CONFLICT:
+        {
+            printf("conflict in the data after the end of the layout\n");
+            appendTail(local, localIndex, localTailSize);
+            result = false;
+        } break;
+    }
+    // the fields were merged one at a time, make sure what came out of that still holds together
+    FileIndex mergedIndex = {};
+    if (!BuildFileIndex(layout, merged.data(), merged.size(), mergedIndex))
+    {
+        printf("the merged result doesn't fit the layout\n");
+        return false;
+    }
+    if (conflictsOut) { *conflictsOut = !result; }
+    return true;
+}
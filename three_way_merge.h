@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "compare_kernels.h"
+#include "file_index.h"
+#include "format_layout.h"
+#include "output_writer.h"
+
+
+// the three-way merge of files that all share one layout: base, local (yours) and remote (theirs).
+// Every field is resolved on its own (see merge_decision.h), see octopus_merge.h for merging more than two revisions
+
+// data-only merge of three files that share the same layout.
+// layout has to be finalized, kernels is the per-row comparison from SelectCompareKernels(layout).
+// merged starts out as a copy of local, so the magic and any padding come along for free.
+// This only covers the fixed part of the file, variable length fields are handled by MergeIndexedData.
+// dataRanges is where any of the three files has data (see sparse_file.h), nullptr if they aren't sparse.
+// Fields that are holes in all three are zero in all three, so they're skipped without reading them.
+// Returns false if any field conflicted (merged then holds local's value for that field)
+bool MergeRecordData(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    const char* base,
+    const char* local,
+    const char* remote,
+    char* merged,
+    const std::vector<ByteRange>* dataRanges = nullptr);
+
+// same as MergeRecordData, but for layouts with variable length fields.
+// Each file has been indexed with BuildFileIndex, so we can go straight to each variable field in each revision.
+// If a variable field has the same number of elements in all three revisions, it's merged element-by-element
+// like an ARRAY. Otherwise someone resized it, and the whole field is treated as one value.
+// SIZEDBUFFERs are opaque blobs (string pools and such), so they're always treated as one value.
+bool MergeIndexedData(
+    const FormatLayout& layout,
+    const FieldCompareFn* kernels,
+    const char* base, const FileIndex& baseIndex,
+    const char* local, const FileIndex& localIndex,
+    const char* remote, const FileIndex& remoteIndex,
+    std::vector<char>& merged,
+    const std::vector<ByteRange>* dataRanges = nullptr);
+
+// merges three whole files that were all written with layout.
+// Unlike MergeRecordData this deals with variable length fields, and with any bytes past the end of
+// what the layout describes (those are treated as one opaque value).
+// dataRanges is the same as for MergeRecordData, it also lets us skip the holes in the tail.
+// Returns false if the files (or the merged result) don't actually fit the layout. conflictsOut is set if anything conflicted
+bool MergeFiles(
+    const FormatLayout& layout,
+    const char* base, size_t baseLen,
+    const char* local, size_t localLen,
+    const char* remote, size_t remoteLen,
+    std::vector<char>& merged,
+    bool* conflictsOut,
+    const std::vector<ByteRange>* dataRanges = nullptr);
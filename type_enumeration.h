@@ -14,6 +14,7 @@ enum Type: int
     CSTRING,
     SIZEDBUFFER,
     STRUCTURE, // for recursive structures, we can have the field's "data" point to another full FormatLayout structure
+    ARRAY, // elementCount elements of elementType, merged element-by-element rather than as one opaque value
 
     NUM_TYPES,
 };
\ No newline at end of file